@@ -3,10 +3,84 @@
 #include <string.h>
 
 static cvbs_context_t *cvbs_context;
+static cvbs_context_t * volatile cvbs_next_context;
 cvbs_context_t *cvbs_get_active_context() {
 	return cvbs_context;
 }
 
+void cvbs_request_switch(cvbs_context_t *ctx) {
+	cvbs_next_context = ctx;
+}
+
+bool cvbs_switch_done() {
+	return !cvbs_next_context;
+}
+
+void cvbs_switch_context(cvbs_context_t *ctx) {
+	cvbs_request_switch(ctx);
+	while (!cvbs_switch_done())
+		cvbs_wait_for_interrupt();
+}
+
+static volatile int16_t raster_line = -1;
+static volatile uint32_t frame_count;
+
+int cvbs_raster_line() {
+	return raster_line;
+}
+
+uint32_t cvbs_frame_count() {
+	return frame_count;
+}
+
+void cvbs_wait_for_interrupt() {
+	__WFI();
+}
+
+// Conditions are checked with interrupts off, so no ISR can slip in between
+// the check and WFI. A pending interrupt still ends WFI, and runs once they
+// are back on.
+void cvbs_wait_for_change(volatile uint32_t *counter) {
+	uint32_t was = *counter;
+	__disable_irq();
+	while (was == *counter) {
+		__WFI();
+		__enable_irq();
+		__disable_irq();
+	}
+	__enable_irq();
+}
+
+void cvbs_wait_for_vsync() {
+	cvbs_wait_for_change(&frame_count);
+}
+
+void cvbs_wait_for_line(int line) {
+	__disable_irq();
+	uint32_t frame = frame_count + (raster_line >= line);
+	while ((int32_t)(frame_count - frame) < 0 || (frame_count == frame && raster_line < line)) {
+		__WFI();
+		__enable_irq();
+		__disable_irq();
+	}
+	__enable_irq();
+}
+
+// Hands the frame over to the requested context on the first line of the
+// pulse sequence. Timers and DMA keep running, so sync is not interrupted.
+static inline void switch_context() {
+	cvbs_context_t *ctx = cvbs_next_context;
+	if (!ctx || cvbs_context->pulse_index || cvbs_context->pulse_counter != cvbs_context->current_pulse.duration)
+		return;
+
+	ctx->pulse_index = 0;
+	ctx->current_pulse = ctx->pulse_properties->pulse_sequence[0];
+	ctx->pulse_counter = ctx->current_pulse.duration;
+	ctx->line = cvbs_context->line;
+	cvbs_context = ctx;
+	cvbs_next_context = 0;
+}
+
 // Hardware requirements:
 //   HCLK must be 48MHz.
 //   Timer1 runs at HCLK, 48MHz;
@@ -16,82 +90,16 @@ cvbs_context_t *cvbs_get_active_context() {
 //   SPI runs at pixel clock, 6MHz.
 //   SPI DMA does 33 transfers to SPI TX buffer.
 
-// Based on the url, interleaved, modified to 480i lines.
-// https://www.batsocks.co.uk/readme/video_timing.htm
-static const cvbs_pulse_properties_t PAL_pulse_properties = {
-    // PAL 50Hz, 64us per scanline
-    .horizontal_period = 3072, // 48MHz * 64us
-    .sync_short        = 113 , // 48MHz * 2.35us
-    .sync_normal       = 226 , // 48MHz * 4.7us
-    .sync_long         = 1310, // 48MHz * (64us/2 - 4.7us)
-
-    // 625 lines = 640 pulses = 30 halfs + 610 periods
-    .pulse_sequence = {
-    //   H  S  L  A    N
-        {1, 0, 1, 0,   5}, // Sync long/2
-        {1, 1, 0, 0,   5}, // Sync short/2
-        {0, 0, 0, 0,  46-5}, // Top blank
-        {0, 0, 0, 1, 230+10}, // Active
-        {0, 0, 0, 0,  29-5}, // Bottom blank
-        {1, 1, 0, 0,   5}, // Sync short/2
-        {1, 0, 1, 0,   5}, // Sync long/2
-        {1, 1, 0, 0,   4}, // Sync short/2
-        {0, 1, 0, 0,   1}, // Sync short
-        {0, 0, 0, 0,  46-5}, // Top blank
-        {0, 0, 0, 1, 230+10}, // Active
-        {0, 0, 0, 0,  28-5}, // Bottom blank
-        {1, 0, 0, 0,   1}, // Bottom blank/2
-        {1, 1, 0, 0,   5}, // Sync short/2
-        {0, 0, 0, 0,   0}, // END
-    }
-};
-
-// Based on the url, progressive scan, then vertically centered.
-// https://www.batsocks.co.uk/readme/video_timing.htm
-static const cvbs_pulse_properties_t ZX81_PAL_pulse_properties = {
-    // PAL 50Hz, 64us per scanline
-    .horizontal_period = 3072, // 48MHz * 64us
-    .sync_short        = 113 , // 48MHz * 2.35us
-    .sync_normal       = 226 , // 48MHz * 4.7us
-    .sync_long         = 1310, // 48MHz * (64us/2 - 4.7us)
-
-    // 625 lines = 640 pulses = 30 halfs + 610 periods
-    .pulse_sequence = {
-    //   H  S  L  A    N
-        {1, 0, 1, 0,   5}, // Sync long/2
-        {1, 1, 0, 0,   5}, // Sync short/2
-        {0, 0, 0, 0,  65}, // Top blank
-        {0, 0, 0, 1, 192}, // Active
-        {0, 0, 0, 0,  47}, // Bottom blank
-        {1, 1, 0, 0,   6}, // Sync short/2
-        {0, 0, 0, 0,   0}, // END
-    }
-};
-
-// Based on the urls, based on 240p NES, then centered.
-// https://www.batsocks.co.uk/readme/video_timing.htm
-// https://www.nesdev.org/wiki/NTSC_video
-static const cvbs_pulse_properties_t ZX81_NTSC_pulse_properties = {
-    .horizontal_period = 48e6 * 63.55e-6 + 0.5,
-    .sync_short        = 48e6 * 4.7e-6/2 + 0.5,
-    .sync_normal       = 48e6 * 4.7e-6 + 0.5,
-    .sync_long         = 48e6 * (63.55e-6 - 4.7e-6) + 0.5,
-
-    // 262 lines
-    .pulse_sequence = {
-    //   H  S  L  A    N
-        {0, 0, 0, 0,  48}, // Pre-render blanking
-        {0, 0, 0, 1, 192}, // 192 active lines centered over 240p.
-        {0, 0, 0, 0,  19}, // Post-render blanking
-        {0, 0, 1, 0,   3}, // Vsync
-        {0, 0, 0, 0,   0}, // END
-    }
-};
+// Pulse tables, generated from a few parameters per standard by
+// timings/make_pulses.py, see there for the sources.
+#include "timings/pulses.h"
 
 static const cvbs_pulse_properties_t *cvbs_pulse_properties[] = {
     [CVBS_STD_PAL] = &PAL_pulse_properties,
     [CVBS_STD_ZX81_PAL] = &ZX81_PAL_pulse_properties,
     [CVBS_STD_ZX81_NTSC] = &ZX81_NTSC_pulse_properties,
+    [CVBS_STD_NTSC] = &NTSC_pulse_properties,
+    [CVBS_STD_PAL_288P] = &PAL_288P_pulse_properties,
 };
 
 /*
@@ -122,9 +130,247 @@ static void spi_init( void )
 	SPI1->CTLR2 |= SPI_CTLR2_TXDMAEN;
 }
 
+// Register values for the next active line, armed by the ISR that starts it.
+static struct {
+	const uint8_t *data;
+	uint16_t data_length;
+	uint16_t dma_start;
+	uint16_t spi_br;
+} next_line;
+
+static inline uint16_t scanline_spi_br(const cvbs_scanline_t *scanline) {
+	if (scanline->flags.pixel_clock_3M)
+		return SPI_BaudRatePrescaler_16;
+	if (scanline->flags.pixel_clock_12M)
+		return SPI_BaudRatePrescaler_4;
+	return SPI_BaudRatePrescaler_8; // pixel clock 6M
+}
+
+void cvbs_display_list_entry(cvbs_context_t *ctx, cvbs_display_list_t *entry, const cvbs_scanline_t *scanline, uint8_t lines, uint8_t repeat, int16_t stride) {
+	entry->data = scanline->data;
+	entry->stride = stride;
+	entry->repeat = repeat ? repeat : 1;
+	entry->lines = lines;
+	entry->data_length = scanline->data_length;
+	entry->dma_start = scanline->horizontal_start + ctx->pulse_properties->sync_normal;
+	entry->spi_br = scanline_spi_br(scanline);
+	entry->context = 0;
+	entry->first_line = 0;
+}
+
+// Lines of a mode context, initialized with the same standard, in a display
+// list. It sees them as its lines first_line onwards.
+void cvbs_display_list_context_entry(cvbs_display_list_t *entry, cvbs_context_t *context, uint8_t lines, uint8_t first_line) {
+	memset(entry, 0, sizeof(*entry));
+	entry->context = context;
+	entry->repeat = 1;
+	entry->lines = lines;
+	entry->first_line = first_line;
+}
+
+// on_vblank for a display list with mode contexts, forwards the blank lines to
+// each of them once, so their frame counters and flips keep working.
+void cvbs_display_list_vblank(cvbs_context_t *ctx) {
+	for (const cvbs_display_list_t *e = ctx->display_list; e && e->lines; e++) {
+		cvbs_context_t *mode = e->context;
+		if (!mode || !mode->on_vblank)
+			continue;
+
+		const cvbs_display_list_t *first = ctx->display_list;
+		while (first->context != mode)
+			first++;
+		if (first != e)
+			continue;
+
+		mode->line = ctx->line;
+		mode->pulse_index = ctx->pulse_index;
+		mode->pulse_counter = ctx->pulse_counter;
+		mode->current_pulse = ctx->current_pulse;
+		mode->on_vblank(mode);
+	}
+}
+
+// A single blank byte, for active lines outside the ones a context shows.
+static inline void blank_step(cvbs_context_t *ctx) {
+	static const uint8_t blank[1];
+	next_line.data = blank;
+	next_line.data_length = 1;
+	next_line.dma_start = cvbs_horizontal_start(ctx) + ctx->pulse_properties->sync_normal;
+}
+
+// Register values for the next line, from a context's on_scanline. Lines
+// around the ones it shows are blank.
+static inline void scanline_step(cvbs_context_t *ctx) {
+	static cvbs_scanline_t scanline;
+	if ((unsigned)ctx->line >= ctx->lines) {
+		blank_step(ctx);
+		return;
+	}
+	ctx->on_scanline(ctx, &scanline);
+
+	next_line.data = scanline.data;
+	next_line.data_length = scanline.data_length;
+	next_line.dma_start = scanline.horizontal_start + ctx->pulse_properties->sync_normal;
+	next_line.spi_br = scanline_spi_br(&scanline);
+}
+
+// Advances the display list cursor by one active line. Lines around the
+// ones the context shows are blank and leave the cursor alone, so it starts
+// over at line 0.
+static inline void display_list_step(cvbs_context_t *ctx) {
+	const cvbs_display_list_t *e = ctx->display_list_entry;
+	if ((unsigned)ctx->line >= ctx->lines) {
+		blank_step(ctx);
+		return;
+	}
+
+	if (!ctx->line || !e) {
+		e = ctx->display_list_entry = ctx->display_list;
+		ctx->display_list_data = e->data;
+		ctx->display_list_lines = e->lines;
+		ctx->display_list_repeat = e->repeat;
+	} else if (e->lines) {
+		if (!--ctx->display_list_lines) {
+			e = ++ctx->display_list_entry;
+			ctx->display_list_data = e->data;
+			ctx->display_list_lines = e->lines;
+			ctx->display_list_repeat = e->repeat;
+		} else if (!--ctx->display_list_repeat) {
+			ctx->display_list_data += e->stride;
+			ctx->display_list_repeat = e->repeat;
+		}
+	}
+
+	// Past the end of the list, send a single blank byte.
+	if (!e->lines) {
+		blank_step(ctx);
+		return;
+	}
+
+	if (e->context) {
+		cvbs_context_t *mode = e->context;
+		mode->line = e->first_line + e->lines - ctx->display_list_lines;
+		scanline_step(mode);
+		return;
+	}
+
+	next_line.data = ctx->display_list_data;
+	next_line.data_length = e->data_length;
+	next_line.dma_start = e->dma_start;
+	next_line.spi_br = e->spi_br;
+}
+
 // Timer Init
 int32_t TIM1_UP_IRQHandler_active_duration;
 int32_t TIM1_UP_IRQHandler_blank_duration;
+
+#if CVBS_PROFILE
+volatile cvbs_profile_t cvbs_profile;
+
+static void profile_class_reset(volatile cvbs_profile_class_t *c) {
+	c->count = 0;
+	c->total = 0;
+	c->min = UINT32_MAX;
+	c->max = 0;
+	c->worst_line = -1;
+	for (int i=0; i<CVBS_PROFILE_BINS; i++)
+		c->histogram[i] = 0;
+}
+
+static void profile_reset() {
+	profile_class_reset(&cvbs_profile.active);
+	profile_class_reset(&cvbs_profile.blank);
+	cvbs_profile.overruns = 0;
+	cvbs_profile.overrun_line = -1;
+}
+
+void cvbs_profile_reset() {
+	NVIC_DisableIRQ(TIM1_UP_IRQn);
+	profile_reset();
+	if (cvbs_context)
+		NVIC_EnableIRQ(TIM1_UP_IRQn);
+}
+
+void cvbs_profile_snapshot(cvbs_profile_t *out) {
+	NVIC_DisableIRQ(TIM1_UP_IRQn);
+	memcpy(out, (const cvbs_profile_t *)&cvbs_profile, sizeof(*out));
+	if (cvbs_context)
+		NVIC_EnableIRQ(TIM1_UP_IRQn);
+}
+
+static inline void profile_class(volatile cvbs_profile_class_t *c, uint32_t t, int line) {
+	c->count++;
+	c->total += t;
+	if (t < c->min)
+		c->min = t;
+	if (t > c->max) {
+		c->max = t;
+		c->worst_line = line;
+	}
+	uint32_t bin = t >> CVBS_PROFILE_BIN_SHIFT;
+	c->histogram[bin < CVBS_PROFILE_BINS ? bin : CVBS_PROFILE_BINS-1]++;
+}
+#endif
+
+#if CVBS_TASKS
+static cvbs_task_t *tasks[CVBS_TASKS];
+static uint8_t task_next;
+volatile uint16_t cvbs_task_budget = CVBS_TASK_BUDGET;
+
+bool cvbs_task_add(cvbs_task_t *task) {
+	for (int i=0; i<CVBS_TASKS; i++) {
+		if (!tasks[i]) {
+			task->pending = false;
+			tasks[i] = task;
+			return true;
+		}
+	}
+	return false;
+}
+
+void cvbs_task_remove(cvbs_task_t *task) {
+	for (int i=0; i<CVBS_TASKS; i++)
+		if (tasks[i] == task)
+			tasks[i] = 0;
+}
+
+// A new frame of work for every task, unfinished work carries on.
+static inline void tasks_frame() {
+	for (int i=0; i<CVBS_TASKS; i++) {
+		cvbs_task_t *task = tasks[i];
+		if (!task)
+			continue;
+		if (task->pending)
+			task->late++;
+		task->pending = true;
+	}
+}
+
+// One step of each pending task in turn, until `limit` cycles are used or
+// all tasks are done. The next call resumes with the next task.
+static void tasks_run(int32_t limit) {
+	int32_t start = SysTick->CNT;
+	for (int idle=0; idle<CVBS_TASKS; ) {
+		int32_t t = SysTick->CNT - start;
+		if (t < 0) t += SysTick->CMP+1;
+		if (t >= limit)
+			return;
+
+		cvbs_task_t *task = tasks[task_next];
+		if (task && task->pending) {
+			idle = 0;
+			if (!task->step(task->arg)) {
+				task->pending = false;
+				task->done++;
+			}
+		} else {
+			idle++;
+		}
+		if (++task_next == CVBS_TASKS)
+			task_next = 0;
+	}
+}
+#endif
 void TIM1_UP_IRQHandler( void ) __attribute__((interrupt));
 void TIM1_UP_IRQHandler() {
 	// Profiling interrupt duration
@@ -133,26 +379,39 @@ void TIM1_UP_IRQHandler() {
 	//
 	TIM1->INTFR &= ~TIM_UIF;
 
-	static cvbs_scanline_t scanline;
+#if CVBS_PROFILE
+	// DMA trigger of the line starting now, 0 when blank.
+	uint16_t dma_trigger = 0;
+#endif
 
 	// Based on the current line
 	if (cvbs_is_active_line(cvbs_context)) {
-		static uint32_t data_length;
-		data_length = scanline.data_length;
-
-		DMA1_Channel3->MADDR = (uint32_t)scanline.data;
-		DMA1_Channel6->MADDR = (uint32_t)&data_length;
-
-		// Enable DMA trigger
-		TIM1->DMAINTENR |= TIM_CC3DE;
-
-		if (scanline.flags.pixel_clock_3M)
-			SPI1->CTLR1 = (SPI1->CTLR1 & ~SPI_CTLR1_BR) | SPI_BaudRatePrescaler_16;
-		else if (scanline.flags.pixel_clock_12M)
-			SPI1->CTLR1 = (SPI1->CTLR1 & ~SPI_CTLR1_BR) | SPI_BaudRatePrescaler_4;
-		else // pixel clock 6M
-			SPI1->CTLR1 = (SPI1->CTLR1 & ~SPI_CTLR1_BR) | SPI_BaudRatePrescaler_8;
+		raster_line = (unsigned)cvbs_context->line < cvbs_context->lines ? cvbs_context->line : -1;
+#if CVBS_PROFILE
+		dma_trigger = next_line.dma_start;
+#endif
+		if (TIM1->CNT + CVBS_LATE_MARGIN >= next_line.dma_start) {
+			// Too late for this line's DMA, leave it blank rather than send
+			// a partial or stale line. Sync below is unaffected.
+			TIM1->DMAINTENR &= ~TIM_CC3DE;
+			cvbs_context->dropped_lines++;
+		} else {
+			static uint32_t data_length;
+			data_length = next_line.data_length;
+
+			DMA1_Channel3->MADDR = (uint32_t)next_line.data;
+			DMA1_Channel6->MADDR = (uint32_t)&data_length;
+
+			// Enable DMA trigger
+			TIM1->DMAINTENR |= TIM_CC3DE;
+
+			SPI1->CTLR1 = (SPI1->CTLR1 & ~SPI_CTLR1_BR) | next_line.spi_br;
+		}
 	} else {
+		if (!cvbs_context->line)
+			frame_count++;
+		raster_line = -1;
+
 		// Stop DMA trigger
 		TIM1->DMAINTENR &= ~TIM_CC3DE;
 	}
@@ -160,17 +419,26 @@ void TIM1_UP_IRQHandler() {
 	// Think about the next line
 	cvbs_step(cvbs_context);
 	if (cvbs_is_active_line(cvbs_context)) {
-		if (cvbs_context->on_scanline)
-			cvbs_context->on_scanline(cvbs_context, &scanline);
+		if (cvbs_context->display_list) {
+			display_list_step(cvbs_context);
+		} else if (cvbs_context->on_scanline) {
+			scanline_step(cvbs_context);
+		}
 	} else {
+		switch_context();
 		if (cvbs_context->on_vblank)
 			cvbs_context->on_vblank(cvbs_context);
 	}
 
+#if CVBS_TASKS
+	// The line starting now, before ATRLR is set for the next one.
+	int32_t period = TIM1->ATRLR;
+#endif
+
 	// Prepare next sync pulse, and horizontal_start
 	TIM1->ATRLR = cvbs_horizontal_period(cvbs_context);
 	TIM1->CH1CVR = cvbs_sync(cvbs_context);
-	TIM1->CH3CVR = scanline.horizontal_start + cvbs_context->pulse_properties->sync_normal;
+	TIM1->CH3CVR = next_line.dma_start;
 
 	// Profiling interrupt duration
 	start_of_interrupt = SysTick->CNT - start_of_interrupt;
@@ -180,6 +448,34 @@ void TIM1_UP_IRQHandler() {
 		TIM1_UP_IRQHandler_active_duration = start_of_interrupt;
 	else
 		TIM1_UP_IRQHandler_blank_duration = start_of_interrupt;
+
+#if CVBS_PROFILE
+	if (cvbs_is_active_line(cvbs_context))
+		profile_class(&cvbs_profile.active, start_of_interrupt, cvbs_context->line);
+	else
+		profile_class(&cvbs_profile.blank, start_of_interrupt, cvbs_context->line);
+
+	// Past the trigger, or past the whole line if the update flag is back.
+	if (dma_trigger && (TIM1->CNT >= dma_trigger || (TIM1->INTFR & TIM_UIF))) {
+		cvbs_profile.overruns++;
+		cvbs_profile.overrun_line = cvbs_context->line;
+	}
+#endif
+
+#if CVBS_TASKS
+	// Tasks get what is left of blank lines, never the next line's time.
+	if (!cvbs_is_active_line(cvbs_context)) {
+		if (!cvbs_context->line)
+			tasks_frame();
+		// TIM1 counts from the update event, so latency and the profiler's
+		// bookkeeping above are left out too.
+		int32_t limit = period - CVBS_TASK_MARGIN - (int32_t)TIM1->CNT;
+		if (limit > cvbs_task_budget)
+			limit = cvbs_task_budget;
+		if (limit > 0)
+			tasks_run(limit);
+	}
+#endif
 }
 
 static void timer_init() {
@@ -244,10 +540,33 @@ static void dma_init() {
 void cvbs_context_init(cvbs_context_t *ctx, cvbs_standard_t cvbs_standard) {
     memset(ctx, 0, sizeof(cvbs_context_t));
     ctx->pulse_properties = cvbs_pulse_properties[cvbs_standard];
+    ctx->lines = cvbs_active_lines(ctx);
+}
+
+unsigned cvbs_active_lines(const cvbs_context_t *ctx) {
+    const cvbs_pulse_t *p = ctx->pulse_properties->pulse_sequence;
+    while (!p->active)
+        p++;
+
+    unsigned n = 0;
+    for (; p->active && p->duration; p++)
+        n += p->duration;
+    return n;
+}
+
+void cvbs_context_set_lines(cvbs_context_t *ctx, unsigned lines) {
+    unsigned active = cvbs_active_lines(ctx);
+    if (lines > active)
+        lines = active;
+    ctx->lines = lines;
+    ctx->top = (active - lines)/2;
 }
 
 void cvbs_init(cvbs_context_t *ctx) {
     cvbs_context = ctx;
+#if CVBS_PROFILE
+    profile_reset();
+#endif
 	RCC->APB2PRSTR &= ~(RCC_TIM1RST | RCC_SPI1RST);
     spi_init();
     timer_init();
@@ -266,4 +585,5 @@ void cvbs_finish(cvbs_context_t *ctx) {
 	RCC->APB2PRSTR |= RCC_TIM1RST | RCC_SPI1RST;
 
 	cvbs_context = 0;
+	cvbs_next_context = 0;
 }
@@ -19,6 +19,29 @@ typedef struct cvbs_scanline_s {
     } flags;
 } cvbs_scanline_t;
 
+// A named on_scanline implementation, modes export null-terminated tables of
+// these so the variant in use can be chosen, and benchmarked, at runtime.
+typedef struct cvbs_kernel_s {
+    const char *name;
+    void (*on_scanline)(cvbs_context_t *ctx, cvbs_scanline_t *scanline);
+} cvbs_kernel_t;
+
+// One display list entry, with register values precomputed for the ISR. Built
+// with cvbs_display_list_entry(), a list ends with an entry of 0 lines.
+// Entries built with cvbs_display_list_context_entry() hand their lines to a
+// mode context instead, so one frame can mix modes and pixel clocks.
+typedef struct cvbs_display_list_s {
+    const uint8_t *data;   // First line's pixels, last byte must be zero
+    cvbs_context_t *context; // Or, when set, renders the lines with on_scanline
+    int16_t stride;        // Added to data every `repeat` lines
+    uint8_t repeat;        // Lines showing the same data
+    uint8_t lines;         // Lines covered by this entry
+    uint16_t data_length;
+    uint16_t dma_start;    // TIM1->CH3CVR
+    uint16_t spi_br;       // SPI1->CTLR1 baud rate bits
+    uint8_t first_line;    // context->line for the entry's first line
+} cvbs_display_list_t;
+
 typedef struct cvbs_pulse_s {
     unsigned half_period : 1;
     unsigned short_sync  : 1;
@@ -41,26 +64,103 @@ struct cvbs_context_s {
     cvbs_pulse_t current_pulse;
     int line;
 
+    // Active lines given to on_scanline, centered in the standard's active
+    // lines, which are sent blank around them. See cvbs_context_set_lines().
+    uint16_t lines;
+    uint16_t top;
+
+    // Field being shown, 1 for the second active block of an interlaced
+    // sequence, else 0.
+    uint8_t field;
+
     const cvbs_pulse_properties_t *pulse_properties;
     void (*on_vblank)(cvbs_context_t *ctx);
     void (*on_scanline)(cvbs_context_t *ctx, cvbs_scanline_t *scanline);
+
+    // Lines left blank because the ISR started too late to arm their DMA,
+    // a sign the callbacks take too long.
+    volatile uint32_t dropped_lines;
+
+    // Optional, takes over from on_scanline when set. Walked by the ISR.
+    const cvbs_display_list_t *display_list;
+    const cvbs_display_list_t *display_list_entry;
+    const uint8_t *display_list_data;
+    uint8_t display_list_lines;
+    uint8_t display_list_repeat;
 };
 
+// Cycles the ISR needs from checking TIM1->CNT to arming the DMA trigger.
+// Lines whose trigger is closer than that are dropped, see dropped_lines.
+#ifndef CVBS_LATE_MARGIN
+#define CVBS_LATE_MARGIN 32
+#endif
+
 typedef enum cvbs_standard_e {
     CVBS_STD_PAL,
     CVBS_STD_ZX81_PAL,
     CVBS_STD_ZX81_NTSC,
+    CVBS_STD_NTSC,      // 480i
+    CVBS_STD_PAL_288P,
 } cvbs_standard_t;
 
 void cvbs_context_init(cvbs_context_t *ctx, cvbs_standard_t cvbs_standard);
+
+// Active lines per field of the context's standard, and the lines a mode
+// shows out of them, vertically centered.
+unsigned cvbs_active_lines(const cvbs_context_t *ctx);
+void cvbs_context_set_lines(cvbs_context_t *ctx, unsigned lines);
 void cvbs_init(cvbs_context_t *ctx);
 void cvbs_finish(cvbs_context_t *ctx);
 cvbs_context_t *cvbs_get_active_context();
 
+// Live mode switch, with video running. The context takes over at the start
+// of the next frame, timers and DMA are left alone so the TV keeps its lock.
+// With the same standard as the current one, sync does not change at all.
+void cvbs_request_switch(cvbs_context_t *ctx);
+bool cvbs_switch_done();
+void cvbs_switch_context(cvbs_context_t *ctx); // Requests and waits, not from interrupts
+
+// Raster position, updated as each line starts. The active line being sent,
+// numbered as ctx->line in on_scanline, or -1 while blank. Frames are counted
+// from cvbs_init(), at the first blank line of each.
+int cvbs_raster_line();
+uint32_t cvbs_frame_count();
+
+// Waits sleep with WFI, and every ISR, once a line, wakes them to check.
+void cvbs_wait_for_interrupt();
+void cvbs_wait_for_change(volatile uint32_t *counter);
+void cvbs_wait_for_vsync();
+// Returns as active line `line` starts, in this frame if still ahead, else in
+// the next. The ISR has prepared line+1 by then, lines after that can still
+// be changed. Lines past the active area return at the next vblank.
+void cvbs_wait_for_line(int line);
+
+void cvbs_display_list_entry(cvbs_context_t *ctx, cvbs_display_list_t *entry, const cvbs_scanline_t *scanline, uint8_t lines, uint8_t repeat, int16_t stride);
+void cvbs_display_list_context_entry(cvbs_display_list_t *entry, cvbs_context_t *context, uint8_t lines, uint8_t first_line);
+void cvbs_display_list_vblank(cvbs_context_t *ctx);
+
 static inline int cvbs_is_active_line(cvbs_context_t *ctx) {
     return ctx->current_pulse.active;
 }
 
+// True on the last blank line before active video, the latest point to get a
+// frame ready from on_vblank.
+static inline bool cvbs_is_last_blank_line(cvbs_context_t *ctx) {
+    if (ctx->pulse_counter != 1)
+        return false;
+
+    const cvbs_pulse_t *next = &ctx->pulse_properties->pulse_sequence[ctx->pulse_index + 1];
+    if (!next->duration)
+        next = &ctx->pulse_properties->pulse_sequence[0];
+    return next->active;
+}
+
+// horizontal_start of the left edge of the picture: sync, then 5.7us of back
+// porch. Every mode starts its lines here.
+static inline uint16_t cvbs_horizontal_start(const cvbs_context_t *ctx) {
+    return (int)(5.7e-6*48e6) + ctx->pulse_properties->sync_normal;
+}
+
 static inline uint16_t cvbs_horizontal_period(cvbs_context_t *ctx) {
     return ctx->pulse_properties->horizontal_period >> ctx->current_pulse.half_period;
 }
@@ -94,11 +194,93 @@ static inline void cvbs_step(cvbs_context_t *ctx) {
 
     bool is_active = cvbs_is_active_line(ctx);
 
-    if (was_active != is_active)
-        ctx->line = 0;
+    if (was_active == is_active)
+        return;
+
+    ctx->line = 0;
+    if (is_active) {
+        // Lines above the mode count up to 0, its first line.
+        ctx->line = -ctx->top;
+        ctx->field = 0;
+        for (int i = ctx->pulse_index; i--; )
+            if (ctx->pulse_properties->pulse_sequence[i].active)
+                ctx->field = 1;
+    }
 }
 
 extern int32_t TIM1_UP_IRQHandler_active_duration;
 extern int32_t TIM1_UP_IRQHandler_blank_duration;
 
+// Optional ISR profiler, build with CVBS_PROFILE=1. Durations are SysTick
+// cycles from ISR entry to exit, as for the two variables above.
+#ifndef CVBS_PROFILE
+#define CVBS_PROFILE 0
+#endif
+
+#if CVBS_PROFILE
+#define CVBS_PROFILE_BINS 8
+#ifndef CVBS_PROFILE_BIN_SHIFT
+#define CVBS_PROFILE_BIN_SHIFT 8 // 256 cycles per histogram bin
+#endif
+
+typedef struct cvbs_profile_class_s {
+    uint32_t count;
+    uint64_t total;         // Sum of durations, total/count is the mean
+    uint32_t min;
+    uint32_t max;
+    int worst_line;         // cvbs_context_t::line the ISR prepared at max
+    uint32_t histogram[CVBS_PROFILE_BINS]; // By duration, the last bin is open ended
+} cvbs_profile_class_t;
+
+typedef struct cvbs_profile_s {
+    cvbs_profile_class_t active; // ISRs preparing an active line
+    cvbs_profile_class_t blank;  // ISRs preparing a blank line
+    uint32_t overruns;           // ISRs still running at their line's DMA trigger
+    int overrun_line;            // cvbs_context_t::line prepared by the last one
+} cvbs_profile_t;
+
+// Updated by the ISR, read it directly or through a snapshot.
+extern volatile cvbs_profile_t cvbs_profile;
+void cvbs_profile_reset();
+void cvbs_profile_snapshot(cvbs_profile_t *out);
+#endif
+
+// Optional vblank task scheduler, build with CVBS_TASKS=n for up to n tasks.
+// Tasks run round robin at the end of the ISR on blank lines, after sync and
+// the profiler are done, for up to cvbs_task_budget SysTick cycles a line,
+// and never within CVBS_TASK_MARGIN cycles of the next line. Work left over
+// carries on in the next blank line.
+#ifndef CVBS_TASKS
+#define CVBS_TASKS 0
+#endif
+
+#if CVBS_TASKS
+#ifndef CVBS_TASK_BUDGET
+#define CVBS_TASK_BUDGET 1536 // Half a line
+#endif
+#ifndef CVBS_TASK_MARGIN
+#define CVBS_TASK_MARGIN 256
+#endif
+
+// Does one short step of the task's work, well under CVBS_TASK_MARGIN cycles,
+// and returns true while there is more for this frame.
+typedef bool (*cvbs_task_step_t)(void *arg);
+
+typedef struct cvbs_task_s {
+    cvbs_task_step_t step;
+    void *arg;
+    volatile uint32_t done; // Frames of work completed
+    volatile uint32_t late; // Frames started before the previous one was done
+    volatile bool pending;  // Set on the first blank line of every frame
+} cvbs_task_t;
+
+// Task cycles per blank line, can be changed at any time.
+extern volatile uint16_t cvbs_task_budget;
+
+// Tasks are kept by pointer, in RAM, until removed. Add returns false when
+// all CVBS_TASKS slots are taken. The first frame starts at the next vblank.
+bool cvbs_task_add(cvbs_task_t *task);
+void cvbs_task_remove(cvbs_task_t *task);
+#endif
+
 #endif // CH32V003_CVBS_H
@@ -0,0 +1,147 @@
+#include "ch32v003_cvbs_format.h"
+#include <string.h>
+
+static const uint32_t powers_of_ten[9] = {
+	1000000000, 100000000, 10000000, 1000000, 100000, 10000, 1000, 100, 10,
+};
+
+int cvbs_format_u32(char *buf, uint32_t v) {
+	char *p = buf;
+	int i = 0;
+	while (i < 9 && v < powers_of_ten[i])
+		i++;
+
+	for (; i<9; i++) {
+		// Digit by binary search. 8e9 does not fit, but the top digit is at most 4.
+		int shift = i ? 3 : 2;
+		uint32_t q = powers_of_ten[i] << shift;
+		char d = '0';
+		for (int bit = 1 << shift; bit; bit >>= 1, q >>= 1) {
+			if (v >= q) {
+				v -= q;
+				d += bit;
+			}
+		}
+		*p++ = d;
+	}
+	*p++ = '0' + v;
+	return p - buf;
+}
+
+int cvbs_format_i32(char *buf, int32_t v) {
+	if (v >= 0)
+		return cvbs_format_u32(buf, v);
+	*buf = '-';
+	return 1 + cvbs_format_u32(buf+1, -(uint32_t)v);
+}
+
+int cvbs_format_hex(char *buf, uint32_t v, int digits, bool upper) {
+	const char *hex = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+	int n = digits > 0 ? digits : 1;
+	if (n > 8) n = 8;
+	while (n < 8 && v >> 4*n)
+		n++;
+
+	for (int i=n; i--; v >>= 4)
+		buf[i] = hex[v & 15];
+	return n;
+}
+
+static void write_padding(cvbs_text_32x24_context_t *ctx, char pad, int n) {
+	const char *fill = pad == '0' ? "00000000" : "        ";
+	for (; n > 0; n -= 8)
+		cvbs_text_32x24_write(ctx, fill, n < 8 ? n : 8);
+}
+
+int cvbs_text_32x24_vprintf(cvbs_text_32x24_context_t *ctx, const char *fmt, va_list ap) {
+	int count = 0;
+
+	while (*fmt) {
+		// Literal text goes out as one run.
+		const char *run = fmt;
+		while (*fmt && *fmt != '%')
+			fmt++;
+		if (fmt != run)
+			count += cvbs_text_32x24_write(ctx, run, fmt - run);
+		if (!*fmt)
+			break;
+		fmt++;
+
+		bool left = false;
+		char pad = ' ';
+		for (;; fmt++) {
+			if (*fmt == '-') left = true;
+			else if (*fmt == '0') pad = '0';
+			else break;
+		}
+
+		int width = 0;
+		while (*fmt >= '0' && *fmt <= '9')
+			width = (width << 3) + (width << 1) + *fmt++ - '0'; // No multiplier either
+
+		bool is_long = false;
+		for (; *fmt == 'l' || *fmt == 'h'; fmt++)
+			if (*fmt == 'l') is_long = true;
+
+		char num[CVBS_FORMAT_MAX];
+		const char *s = num;
+		int len = 1;
+		switch (*fmt) {
+			case 'd':
+			case 'i':
+				len = cvbs_format_i32(num, is_long ? va_arg(ap, long) : va_arg(ap, int));
+				break;
+
+			case 'u':
+				len = cvbs_format_u32(num, is_long ? va_arg(ap, unsigned long) : va_arg(ap, unsigned));
+				break;
+
+			case 'x':
+			case 'X':
+				len = cvbs_format_hex(num, is_long ? va_arg(ap, unsigned long) : va_arg(ap, unsigned), 0, *fmt == 'X');
+				break;
+
+			case 'c':
+				num[0] = va_arg(ap, int);
+				break;
+
+			case 's':
+				s = va_arg(ap, const char *);
+				len = strlen(s);
+				break;
+
+			case 0:
+				continue;
+
+			default: // %% and unknown conversions print as is.
+				num[0] = *fmt;
+				break;
+		}
+		fmt++;
+
+		width -= len;
+		if (!left) {
+			// Zero padding goes between the sign and the digits.
+			if (pad == '0' && *s == '-' && width > 0) {
+				count += cvbs_text_32x24_write(ctx, s++, 1);
+				len--;
+			}
+			write_padding(ctx, pad, width);
+		}
+		count += cvbs_text_32x24_write(ctx, s, len);
+		if (left)
+			write_padding(ctx, ' ', width);
+		if (width > 0)
+			count += width;
+	}
+
+	return count;
+}
+
+int cvbs_text_32x24_printf(cvbs_text_32x24_context_t *ctx, const char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	int n = cvbs_text_32x24_vprintf(ctx, fmt, ap);
+	va_end(ap);
+	return n;
+}
@@ -0,0 +1,27 @@
+#pragma once
+// Number formatting without division.
+//
+// RV32EC has neither divide nor multiply, so printf's per-digit `/10` and `%10`
+// end up in libgcc loops. Decimal digits here are found by subtracting 8, 4,
+// 2 and 1 times each power of ten, at most 4 compares per digit.
+//
+// Formatters write into buf with no terminator, and return the length.
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "ch32v003_cvbs_text_32x24.h"
+
+// Longest output of any formatter, "-2147483648".
+#define CVBS_FORMAT_MAX 11
+
+int cvbs_format_u32(char *buf, uint32_t v);
+int cvbs_format_i32(char *buf, int32_t v);
+
+// At least `digits` hex digits, zero padded, up to 8. Zero gives the minimum.
+int cvbs_format_hex(char *buf, uint32_t v, int digits, bool upper);
+
+// Small printf to VRAM at the cursor: %d %i %u %x %X %c %s %%, with the `-`
+// and `0` flags, field width, and `l`/`h` size prefixes. No precision, and no
+// floats. Returns the number of characters written.
+int cvbs_text_32x24_vprintf(cvbs_text_32x24_context_t *ctx, const char *fmt, va_list ap);
+int cvbs_text_32x24_printf(cvbs_text_32x24_context_t *ctx, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
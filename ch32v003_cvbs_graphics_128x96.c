@@ -2,32 +2,215 @@
 #include "container_of.h"
 #include <string.h>
 
+#if CVBS_GRAPHICS_128X96_SPRITES
+// Sorts the visible sprites by y, as late as possible so the foreground can
+// move them during vblank.
+static void sprites_sort(cvbs_graphics_128x96_context_t *ctx) {
+	unsigned n = 0;
+	for (unsigned i=0; i<CVBS_GRAPHICS_128X96_SPRITES; i++) {
+		const cvbs_graphics_128x96_sprite_t *s = &ctx->sprites[i];
+		int w = s->wide ? 16 : 8;
+		if (!s->height || s->x <= -w || s->x >= 128 || s->y >= 96 || s->y + s->height <= 0)
+			continue;
+
+		unsigned j = n++;
+		for (; j && ctx->sprites[ctx->sprite_order[j-1]].y > s->y; j--)
+			ctx->sprite_order[j] = ctx->sprite_order[j-1];
+		ctx->sprite_order[j] = i;
+	}
+	ctx->sprite_count = n;
+}
+#endif
+
 static void on_vblank(cvbs_context_t *cvbs) {
 	cvbs_graphics_128x96_context_t *cvbs_gfx = container_of(cvbs, cvbs_graphics_128x96_context_t, cvbs);
-	if (!cvbs->line) cvbs_gfx->frame_counter++;
+#if CVBS_GRAPHICS_128X96_SPRITES
+	if (cvbs_is_last_blank_line(cvbs))
+		sprites_sort(cvbs_gfx);
+#endif
+	if (cvbs->line)
+		return;
+
+	cvbs_gfx->frame_counter++;
+	if (cvbs_gfx->flip_state == CVBS_GRAPHICS_128X96_FLIP_REQUESTED) {
+		uint8_t *page = cvbs_gfx->front;
+		cvbs_gfx->front = cvbs_gfx->back;
+		cvbs_gfx->back = page;
+		cvbs_gfx->flip_state = CVBS_GRAPHICS_128X96_FLIP_DONE;
+	}
+
+#if CVBS_GRAPHICS_128X96_SPRITES
+	// Collisions of the frame just shown.
+	for (unsigned i=0; i<CVBS_GRAPHICS_128X96_SPRITES; i++) {
+		cvbs_gfx->collisions[i] = cvbs_gfx->sprite_hits[i];
+		cvbs_gfx->sprite_hits[i] = 0;
+	}
+#endif
 }
 
-//
+// Rows are sent straight from VRAM, each one on two consecutive lines.
 static void on_scanline(cvbs_context_t *cvbs, cvbs_scanline_t *scanline) {
 	cvbs_graphics_128x96_context_t *cvbs_gfx = container_of(cvbs, cvbs_graphics_128x96_context_t, cvbs);
-	int line = cvbs->line / 2;
-	uint8_t *img  = line&1 ? cvbs_gfx->VRAM1 : cvbs_gfx->VRAM0;
-
-	const uint8_t *src  = cvbs_gfx->VRAM + line*(128/8);
-	memcpy(img, src, 128/8);
-	img[128/8] = 0;
-
-	const cvbs_pulse_properties_t *pp = cvbs->pulse_properties;
-	memset(scanline, 0, sizeof(*scanline));
-	scanline->horizontal_start = (int)(5.7e-6*48e6) + pp->sync_normal;
-	scanline->data_length = 17;
-	scanline->data = img;
+
+	scanline->horizontal_start = cvbs_horizontal_start(cvbs);
+	scanline->data_length = CVBS_GRAPHICS_128X96_STRIDE;
+	scanline->data = cvbs_gfx->front + cvbs->line/2 * CVBS_GRAPHICS_128X96_STRIDE;
+	scanline->flags.pixel_clock_12M = 0;
 	scanline->flags.pixel_clock_3M = 1;
 }
 
-void cvbs_graphics_128x96_context_init(cvbs_graphics_128x96_context_t *cvbs_gfx) {
+#if CVBS_GRAPHICS_128X96_SPRITES
+// Row of a sprite as 16 pixels, leftmost at bit 15.
+static inline uint32_t sprite_bits(const uint8_t *p, bool wide) {
+	return wide ? p[0] << 8 | p[1] : p[0] << 8;
+}
+
+// Updates the sprites on row y, returns the row to send: VRAM when there are
+// none, else a line buffer with them composited over VRAM.
+static const uint8_t *sprites_row(cvbs_graphics_128x96_context_t *ctx, unsigned y) {
+	const cvbs_graphics_128x96_sprite_t *sprites = ctx->sprites;
+	uint8_t *row = ctx->sprite_row;
+	if (!y) {
+		ctx->sprite_next = 0;
+		ctx->sprite_row_count = 0;
+	}
+
+	// Drop the sprites that ended, keeping priority order.
+	unsigned n = 0;
+	for (unsigned i=0; i<ctx->sprite_row_count; i++) {
+		const cvbs_graphics_128x96_sprite_t *s = &sprites[row[i]];
+		if (y - s->y < s->height)
+			row[n++] = row[i];
+	}
+
+	// Add the ones starting here. Full rows keep the highest priorities.
+	while (ctx->sprite_next < ctx->sprite_count) {
+		unsigned k = ctx->sprite_order[ctx->sprite_next];
+		const cvbs_graphics_128x96_sprite_t *s = &sprites[k];
+		if (s->y > (int)y)
+			break;
+		ctx->sprite_next++;
+		if (y - s->y >= s->height)
+			continue;
+
+		if (n == CVBS_GRAPHICS_128X96_SPRITES_PER_ROW) {
+			ctx->sprite_overflows++;
+			if (s->priority <= sprites[row[0]].priority)
+				continue;
+			for (unsigned i=1; i<n; i++)
+				row[i-1] = row[i];
+			n--;
+		}
+		unsigned j = n++;
+		for (; j && sprites[row[j-1]].priority > s->priority; j--)
+			row[j] = row[j-1];
+		row[j] = k;
+	}
+	ctx->sprite_row_count = n;
+
+	const uint8_t *vram = ctx->front + y*CVBS_GRAPHICS_128X96_STRIDE;
+	if (!n)
+		return vram;
+
+	// The other buffer may still be going out, rows alternate between them.
+	uint8_t *line = ctx->sprite_line[y&1];
+	memcpy(line, vram, 128/8);
+
+	int xs[CVBS_GRAPHICS_128X96_SPRITES_PER_ROW];
+	uint32_t shapes[CVBS_GRAPHICS_128X96_SPRITES_PER_ROW];
+	for (unsigned i=0; i<n; i++) {
+		const cvbs_graphics_128x96_sprite_t *s = &sprites[row[i]];
+		unsigned offset = (y - s->y) << (s->wide ? 1 : 0);
+		uint32_t bits = sprite_bits(s->bitmap + offset, s->wide);
+		uint32_t mask = s->mask ? sprite_bits(s->mask + offset, s->wide) : bits;
+
+		// Clip to the screen, then place in the 3 bytes from x/8 on.
+		int x = s->x;
+		if (x < 0)
+			mask &= 0xFFFF >> -x;
+		else if (x > 128-16)
+			mask &= 0xFFFF << (x - (128-16));
+		bits &= mask;
+		xs[i] = x;
+		shapes[i] = mask;
+
+		uint8_t *p = line + (x >> 3);
+		unsigned shift = 8 - (x & 7);
+		bits <<= shift;
+		mask <<= shift;
+		for (int b=16; b>=0; b-=8, p++) {
+			uint8_t m = mask >> b;
+			if (m)
+				*p = (*p & ~m) | (uint8_t)(bits >> b);
+		}
+	}
+
+	// Collisions between the shapes, by the distance between sprites.
+	for (unsigned i=0; i<n; i++) {
+		for (unsigned j=i+1; j<n; j++) {
+			int d = xs[j] - xs[i];
+			bool hit = d >= 0 ? d < 16 && (shapes[i] & shapes[j] >> d) : d > -16 && (shapes[j] & shapes[i] >> -d);
+			if (hit) {
+				ctx->sprite_hits[row[i]] |= 1 << row[j];
+				ctx->sprite_hits[row[j]] |= 1 << row[i];
+			}
+		}
+	}
+	return line;
+}
+
+// Sprites over VRAM. Each row is composited on its first line, and shown again
+// from the same buffer on the second.
+static void on_scanline_sprites(cvbs_context_t *cvbs, cvbs_scanline_t *scanline) {
+	cvbs_graphics_128x96_context_t *cvbs_gfx = container_of(cvbs, cvbs_graphics_128x96_context_t, cvbs);
+
+	on_scanline(cvbs, scanline);
+	if (!(cvbs->line & 1))
+		cvbs_gfx->sprite_data = sprites_row(cvbs_gfx, cvbs->line/2);
+	scanline->data = cvbs_gfx->sprite_data;
+}
+#endif
+
+const cvbs_kernel_t cvbs_graphics_128x96_kernels[] = {
+#if CVBS_GRAPHICS_128X96_SPRITES
+	{ "sprites", on_scanline_sprites },
+#endif
+	{ "zerocopy", on_scanline },
+	{ 0 }
+};
+
+void cvbs_graphics_128x96_fill(cvbs_graphics_128x96_context_t *ctx, uint8_t pattern) {
+	for (unsigned y=0; y<96; y++)
+		memset(cvbs_graphics_128x96_row(ctx, y), pattern, 128/8);
+}
+
+bool cvbs_graphics_128x96_flip_done(cvbs_graphics_128x96_context_t *ctx) {
+	if (ctx->flip_state == CVBS_GRAPHICS_128X96_FLIP_REQUESTED)
+		return false;
+	if (ctx->flip_state == CVBS_GRAPHICS_128X96_FLIP_IDLE)
+		return true;
+
+#if CVBS_GRAPHICS_128X96_PAGES > 1
+	for (unsigned y=0; y<96; y++) {
+		if (ctx->dirty[y/8] & 1 << y%8)
+			memcpy(ctx->back + y*CVBS_GRAPHICS_128X96_STRIDE, ctx->front + y*CVBS_GRAPHICS_128X96_STRIDE, 128/8);
+	}
+	memset(ctx->dirty, 0, sizeof(ctx->dirty));
+#endif
+	ctx->flip_state = CVBS_GRAPHICS_128X96_FLIP_IDLE;
+	return true;
+}
+
+void cvbs_graphics_128x96_context_init(cvbs_graphics_128x96_context_t *cvbs_gfx, cvbs_standard_t standard) {
 	memset(cvbs_gfx, 0, sizeof(*cvbs_gfx));
-	cvbs_context_init(&cvbs_gfx->cvbs, CVBS_STD_ZX81_NTSC);
-	cvbs_gfx->cvbs.on_scanline = on_scanline;
+	cvbs_context_init(&cvbs_gfx->cvbs, standard);
+	cvbs_context_set_lines(&cvbs_gfx->cvbs, 96*2);
+	cvbs_gfx->cvbs.on_scanline = cvbs_graphics_128x96_kernels[0].on_scanline;
 	cvbs_gfx->cvbs.on_vblank = on_vblank;
+	cvbs_gfx->front = cvbs_gfx->VRAM;
+#if CVBS_GRAPHICS_128X96_PAGES > 1
+	cvbs_gfx->back = cvbs_gfx->VRAM_page1;
+#else
+	cvbs_gfx->back = cvbs_gfx->VRAM;
+#endif
 }
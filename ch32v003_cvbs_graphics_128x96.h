@@ -1,19 +1,137 @@
 #pragma once
 #include <ch32v003_cvbs.h>
 
+// Each row is 16 bytes of pixels followed by a zero guard byte, so the DMA can
+// send rows straight from VRAM. Never write the guard byte.
+#define CVBS_GRAPHICS_128X96_STRIDE (128/8+1)
+
+// Pages of VRAM, 1 or 2. Two pages are 3264 bytes, more than the CH32V003 has.
+#ifndef CVBS_GRAPHICS_128X96_PAGES
+#define CVBS_GRAPHICS_128X96_PAGES 1
+#endif
+
+// Sprites composited over VRAM by the scanline kernel, 0 to 8. Rows showing
+// sprites are copied to a line buffer first, VRAM is never written.
+#ifndef CVBS_GRAPHICS_128X96_SPRITES
+#define CVBS_GRAPHICS_128X96_SPRITES 0
+#endif
+
+// Sprites composited on one row, bounding the kernel's cost per line.
+#ifndef CVBS_GRAPHICS_128X96_SPRITES_PER_ROW
+#define CVBS_GRAPHICS_128X96_SPRITES_PER_ROW 4
+#endif
+
+#if CVBS_GRAPHICS_128X96_SPRITES
+typedef struct cvbs_graphics_128x96_sprite_s {
+	const uint8_t *bitmap; // height rows of 1 byte, 2 if wide, MSB at the left
+	const uint8_t *mask;   // Same layout, pixels the bitmap replaces. NULL ORs it in
+	int16_t x, y;          // Top left pixel, may be partly off screen
+	uint8_t height;        // 0 hides the sprite
+	uint8_t wide;          // 16 pixels wide instead of 8
+	uint8_t priority;      // Higher is drawn on top
+} cvbs_graphics_128x96_sprite_t;
+#endif
+
 typedef struct cvbs_graphics_128x96_context_s {
 	cvbs_context_t cvbs;
 	uint32_t frame_counter;
 
-	uint8_t VRAM0[128/8+4];
-	uint8_t VRAM1[128/8+4];
-	uint8_t VRAM[128*96/8];
+	// Page shown, and page drawn by the helpers. The same one with 1 page.
+	uint8_t *front;
+	uint8_t *back;
+	volatile uint8_t flip_state;
+
+#if CVBS_GRAPHICS_128X96_PAGES > 1
+	// Rows drawn on the back page since the last flip, one bit each.
+	uint8_t dirty[96/8];
+	uint8_t VRAM_page1[96*CVBS_GRAPHICS_128X96_STRIDE];
+#endif
+
+#if CVBS_GRAPHICS_128X96_SPRITES
+	// Read while the frame is shown, change them after wait_for_vsync() or
+	// flip(). Sprites are sorted by y once per frame, at the end of vblank.
+	cvbs_graphics_128x96_sprite_t sprites[CVBS_GRAPHICS_128X96_SPRITES];
+	// Per sprite, the others it overlapped in the last frame, one bit each.
+	volatile uint8_t collisions[CVBS_GRAPHICS_128X96_SPRITES];
+	// Sprites left out of a row with SPRITES_PER_ROW already on it.
+	volatile uint32_t sprite_overflows;
+
+	// Kernel state: sprites by y, the ones on the current row by priority.
+	uint8_t sprite_order[CVBS_GRAPHICS_128X96_SPRITES];
+	uint8_t sprite_count;
+	uint8_t sprite_next;
+	uint8_t sprite_row[CVBS_GRAPHICS_128X96_SPRITES_PER_ROW];
+	uint8_t sprite_row_count;
+	uint8_t sprite_hits[CVBS_GRAPHICS_128X96_SPRITES];
+	const uint8_t *sprite_data;
+	uint8_t sprite_line[2][CVBS_GRAPHICS_128X96_STRIDE];
+#endif
+	uint8_t VRAM[96*CVBS_GRAPHICS_128X96_STRIDE];
 } cvbs_graphics_128x96_context_t;
 
 static inline void cvbs_graphics_128x96_wait_for_vsync(cvbs_graphics_128x96_context_t *ctx) {
-	volatile uint32_t *is = &ctx->frame_counter;
-	unsigned was = *is;
-	while (was == *is);
+	cvbs_wait_for_change(&ctx->frame_counter);
+}
+
+// First pixel byte of row y on the back page, 16 bytes, MSB at the left. The
+// row is assumed to be written, and is marked dirty.
+static inline uint8_t *cvbs_graphics_128x96_row(cvbs_graphics_128x96_context_t *ctx, unsigned y) {
+#if CVBS_GRAPHICS_128X96_PAGES > 1
+	ctx->dirty[y/8] |= 1 << y%8;
+#endif
+	return ctx->back + y*CVBS_GRAPHICS_128X96_STRIDE;
+}
+
+// Marks rows y0 to y1 as drawn, for code that walks rows by the stride.
+static inline void cvbs_graphics_128x96_mark_rows(cvbs_graphics_128x96_context_t *ctx, unsigned y0, unsigned y1) {
+#if CVBS_GRAPHICS_128X96_PAGES > 1
+	for (unsigned y=y0; y<=y1; y++)
+		ctx->dirty[y/8] |= 1 << y%8;
+#endif
 }
 
-void cvbs_graphics_128x96_context_init(cvbs_graphics_128x96_context_t *cvbs_text);
+static inline bool cvbs_graphics_128x96_get_pixel(cvbs_graphics_128x96_context_t *ctx, unsigned x, unsigned y) {
+	return ctx->back[y*CVBS_GRAPHICS_128X96_STRIDE + x/8] & (0x80 >> x%8);
+}
+
+static inline void cvbs_graphics_128x96_set_pixel(cvbs_graphics_128x96_context_t *ctx, unsigned x, unsigned y, bool on) {
+	uint8_t *p = &cvbs_graphics_128x96_row(ctx, y)[x/8];
+	if (on)
+		*p |= 0x80 >> x%8;
+	else
+		*p &= ~(0x80 >> x%8);
+}
+
+// Fills every row with a byte pattern, leaving the guard bytes alone.
+void cvbs_graphics_128x96_fill(cvbs_graphics_128x96_context_t *ctx, uint8_t pattern);
+
+// Page flipping. A flip is requested from the foreground and done by
+// on_vblank at line 0, so the new page is shown from its first line. With one
+// page it only waits for that point.
+enum {
+	CVBS_GRAPHICS_128X96_FLIP_IDLE,
+	CVBS_GRAPHICS_128X96_FLIP_REQUESTED,
+	CVBS_GRAPHICS_128X96_FLIP_DONE,
+};
+
+// Shows the back page from the next frame. Do not draw until
+// cvbs_graphics_128x96_flip_done() returns true.
+static inline void cvbs_graphics_128x96_request_flip(cvbs_graphics_128x96_context_t *ctx) {
+	ctx->flip_state = CVBS_GRAPHICS_128X96_FLIP_REQUESTED;
+}
+
+// False while a flip is pending. Once it happened, copies the rows drawn
+// before it to the new back page, so drawing carries on from what is shown.
+bool cvbs_graphics_128x96_flip_done(cvbs_graphics_128x96_context_t *ctx);
+
+// Requests a flip and waits for it, replaces wait_for_vsync when animating.
+static inline void cvbs_graphics_128x96_flip(cvbs_graphics_128x96_context_t *ctx) {
+	cvbs_graphics_128x96_request_flip(ctx);
+	while (!cvbs_graphics_128x96_flip_done(ctx))
+		cvbs_wait_for_interrupt();
+}
+
+extern const cvbs_kernel_t cvbs_graphics_128x96_kernels[];
+
+// The 192 lines are centered in the standard's active lines.
+void cvbs_graphics_128x96_context_init(cvbs_graphics_128x96_context_t *cvbs_gfx, cvbs_standard_t standard);
@@ -0,0 +1,242 @@
+#include "ch32v003_cvbs_graphics_128x96_draw.h"
+
+#define WIDTH 128
+#define HEIGHT 96
+
+// Applies the source bits selected by mask.
+static inline void apply(uint8_t *p, uint8_t bits, uint8_t mask, cvbs_graphics_128x96_op_t op) {
+	switch (op) {
+		case CVBS_GRAPHICS_128X96_SET:   *p |= bits & mask; break;
+		case CVBS_GRAPHICS_128X96_CLEAR: *p &= ~(bits & mask); break;
+		case CVBS_GRAPHICS_128X96_XOR:   *p ^= bits & mask; break;
+		case CVBS_GRAPHICS_128X96_COPY:  *p = (*p & ~mask) | (bits & mask); break;
+	}
+}
+
+static inline void swap(int *a, int *b) {
+	int t = *a;
+	*a = *b;
+	*b = t;
+}
+
+// Pixels x0 to x1 of a row, already clipped and ordered.
+static void span(uint8_t *row, int x0, int x1, cvbs_graphics_128x96_op_t op) {
+	uint8_t *p = row + x0/8;
+	uint8_t *last = row + x1/8;
+	uint8_t first_mask = 0xFF >> x0%8;
+	uint8_t last_mask = 0xFF << (7 - x1%8);
+
+	if (p == last) {
+		apply(p, 0xFF, first_mask & last_mask, op);
+		return;
+	}
+
+	apply(p++, 0xFF, first_mask, op);
+	switch (op) {
+		case CVBS_GRAPHICS_128X96_SET:
+		case CVBS_GRAPHICS_128X96_COPY:
+			while (p < last) *p++ = 0xFF;
+			break;
+		case CVBS_GRAPHICS_128X96_CLEAR:
+			while (p < last) *p++ = 0x00;
+			break;
+		case CVBS_GRAPHICS_128X96_XOR:
+			while (p < last) *p++ ^= 0xFF;
+			break;
+	}
+	apply(p, 0xFF, last_mask, op);
+}
+
+void cvbs_graphics_128x96_pixel(cvbs_graphics_128x96_context_t *ctx, int x, int y, cvbs_graphics_128x96_op_t op) {
+	if ((unsigned)x >= WIDTH || (unsigned)y >= HEIGHT)
+		return;
+	apply(cvbs_graphics_128x96_row(ctx, y) + x/8, 0xFF, 0x80 >> x%8, op);
+}
+
+void cvbs_graphics_128x96_hline(cvbs_graphics_128x96_context_t *ctx, int x0, int x1, int y, cvbs_graphics_128x96_op_t op) {
+	if (x0 > x1) swap(&x0, &x1);
+	if ((unsigned)y >= HEIGHT || x1 < 0 || x0 >= WIDTH)
+		return;
+	if (x0 < 0) x0 = 0;
+	if (x1 >= WIDTH) x1 = WIDTH-1;
+	span(cvbs_graphics_128x96_row(ctx, y), x0, x1, op);
+}
+
+// Op is a constant once inlined into the switch below, so the loop has no
+// branch on it.
+static inline __attribute__((always_inline)) void vline(cvbs_graphics_128x96_context_t *ctx, int x, int y0, int y1, cvbs_graphics_128x96_op_t op) {
+	uint8_t mask = 0x80 >> x%8;
+	uint8_t *p = cvbs_graphics_128x96_row(ctx, y0) + x/8;
+	for (int y=y0; y<=y1; y++, p += CVBS_GRAPHICS_128X96_STRIDE)
+		apply(p, 0xFF, mask, op);
+}
+
+void cvbs_graphics_128x96_vline(cvbs_graphics_128x96_context_t *ctx, int x, int y0, int y1, cvbs_graphics_128x96_op_t op) {
+	if (y0 > y1) swap(&y0, &y1);
+	if ((unsigned)x >= WIDTH || y1 < 0 || y0 >= HEIGHT)
+		return;
+	if (y0 < 0) y0 = 0;
+	if (y1 >= HEIGHT) y1 = HEIGHT-1;
+
+	switch (op) {
+		case CVBS_GRAPHICS_128X96_SET:   vline(ctx, x, y0, y1, CVBS_GRAPHICS_128X96_SET); break;
+		case CVBS_GRAPHICS_128X96_CLEAR: vline(ctx, x, y0, y1, CVBS_GRAPHICS_128X96_CLEAR); break;
+		case CVBS_GRAPHICS_128X96_XOR:   vline(ctx, x, y0, y1, CVBS_GRAPHICS_128X96_XOR); break;
+		case CVBS_GRAPHICS_128X96_COPY:  vline(ctx, x, y0, y1, CVBS_GRAPHICS_128X96_SET); break;
+	}
+	cvbs_graphics_128x96_mark_rows(ctx, y0, y1);
+}
+
+// Bresenham, clipping every pixel. For lines leaving the screen.
+static void line_clipped(cvbs_graphics_128x96_context_t *ctx, int x0, int y0, int x1, int y1, cvbs_graphics_128x96_op_t op) {
+	int dx = x1 > x0 ? x1 - x0 : x0 - x1;
+	int dy = y1 > y0 ? y0 - y1 : y1 - y0;
+	int sx = x0 < x1 ? 1 : -1;
+	int sy = y0 < y1 ? 1 : -1;
+	int err = dx + dy;
+
+	while (true) {
+		cvbs_graphics_128x96_pixel(ctx, x0, y0, op);
+		if (x0 == x1 && y0 == y1)
+			break;
+
+		int e2 = 2*err;
+		if (e2 >= dy) {
+			err += dy;
+			x0 += sx;
+		}
+		if (e2 <= dx) {
+			err += dx;
+			y0 += sy;
+		}
+	}
+}
+
+void cvbs_graphics_128x96_line(cvbs_graphics_128x96_context_t *ctx, int x0, int y0, int x1, int y1, cvbs_graphics_128x96_op_t op) {
+	if (y0 == y1) {
+		cvbs_graphics_128x96_hline(ctx, x0, x1, y0, op);
+		return;
+	}
+	if (x0 == x1) {
+		cvbs_graphics_128x96_vline(ctx, x0, y0, y1, op);
+		return;
+	}
+	if ((unsigned)x0 >= WIDTH || (unsigned)x1 >= WIDTH || (unsigned)y0 >= HEIGHT || (unsigned)y1 >= HEIGHT) {
+		line_clipped(ctx, x0, y0, x1, y1, op);
+		return;
+	}
+
+	// Same walk as line_clipped(), moving a byte pointer and bit mask along.
+	int dx = x1 > x0 ? x1 - x0 : x0 - x1;
+	int dy = y1 > y0 ? y0 - y1 : y1 - y0;
+	int sx = x0 < x1 ? 1 : -1;
+	int sy = y0 < y1 ? 1 : -1;
+	int err = dx + dy;
+	int step = sy * CVBS_GRAPHICS_128X96_STRIDE;
+
+	if (sy > 0)
+		cvbs_graphics_128x96_mark_rows(ctx, y0, y1);
+	else
+		cvbs_graphics_128x96_mark_rows(ctx, y1, y0);
+	uint8_t *p = cvbs_graphics_128x96_row(ctx, y0) + x0/8;
+	uint8_t mask = 0x80 >> x0%8;
+	while (true) {
+		apply(p, 0xFF, mask, op);
+		if (x0 == x1 && y0 == y1)
+			break;
+
+		int e2 = 2*err;
+		if (e2 >= dy) {
+			err += dy;
+			x0 += sx;
+			if (sx > 0) {
+				if (!(mask >>= 1)) {
+					mask = 0x80;
+					p++;
+				}
+			} else if (!(mask = mask << 1)) {
+				mask = 0x01;
+				p--;
+			}
+		}
+		if (e2 <= dx) {
+			err += dx;
+			y0 += sy;
+			p += step;
+		}
+	}
+}
+
+void cvbs_graphics_128x96_rect(cvbs_graphics_128x96_context_t *ctx, int x, int y, int w, int h, cvbs_graphics_128x96_op_t op) {
+	if (w <= 0 || h <= 0)
+		return;
+	cvbs_graphics_128x96_hline(ctx, x, x+w-1, y, op);
+	if (h > 1)
+		cvbs_graphics_128x96_hline(ctx, x, x+w-1, y+h-1, op);
+	if (h > 2) {
+		cvbs_graphics_128x96_vline(ctx, x, y+1, y+h-2, op);
+		if (w > 1)
+			cvbs_graphics_128x96_vline(ctx, x+w-1, y+1, y+h-2, op);
+	}
+}
+
+void cvbs_graphics_128x96_fill_rect(cvbs_graphics_128x96_context_t *ctx, int x, int y, int w, int h, cvbs_graphics_128x96_op_t op) {
+	int x1 = x + w - 1;
+	int y1 = y + h - 1;
+	if (x < 0) x = 0;
+	if (y < 0) y = 0;
+	if (x1 >= WIDTH) x1 = WIDTH-1;
+	if (y1 >= HEIGHT) y1 = HEIGHT-1;
+
+	for (; y<=y1 && x<=x1; y++)
+		span(cvbs_graphics_128x96_row(ctx, y), x, x1, op);
+}
+
+void cvbs_graphics_128x96_blit(cvbs_graphics_128x96_context_t *ctx, int x, int y,
+	const uint8_t *src, int w, int h, int stride, cvbs_graphics_128x96_op_t op)
+{
+	int shift = x & 7;
+	int first = x >> 3; // Rounds down for negative x too
+	int bytes = (w + 7) / 8;
+	uint8_t last_mask = 0xFF << (-w & 7);
+
+	for (; h > 0; h--, y++, src += stride) {
+		if ((unsigned)y >= HEIGHT)
+			continue;
+
+		uint8_t *row = cvbs_graphics_128x96_row(ctx, y);
+		for (int i=0; i<bytes; i++) {
+			uint8_t mask = i == bytes-1 ? last_mask : 0xFF;
+			int d = first + i;
+			if ((unsigned)d < WIDTH/8)
+				apply(row + d, src[i] >> shift, mask >> shift, op);
+			if (shift && (unsigned)(d+1) < WIDTH/8)
+				apply(row + d+1, src[i] << (8-shift), mask << (8-shift), op);
+		}
+	}
+}
+
+int cvbs_graphics_128x96_text(cvbs_graphics_128x96_context_t *ctx, int x, int y,
+	const uint8_t *font, const char *s, cvbs_graphics_128x96_op_t op)
+{
+	const int x_start = x;
+	const uint8_t shift = *font++;
+	const uint8_t glyph_mask = (1 << shift) - 1;
+	uint8_t glyph[8];
+
+	for (; *s; s++) {
+		uint8_t c = *s;
+		if (c == '\n') {
+			x = x_start;
+			y += 8;
+			continue;
+		}
+
+		uint8_t invert = c & ~glyph_mask ? 0xFF : 0x00;
+		for (int r=0; r<8; r++)
+			glyph[r] = font[(r << shift) + (c & glyph_mask)] ^ invert;
+		cvbs_graphics_128x96_blit(ctx, x, y, glyph, 8, 8, 1, op);
+		x += 8;
+	}
+	return x;
+}
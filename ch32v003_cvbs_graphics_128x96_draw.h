@@ -0,0 +1,35 @@
+#pragma once
+// Drawing primitives for the 128x96 graphics mode.
+//
+// Everything draws on the back page through cvbs_graphics_128x96_row(), so
+// rows are marked dirty, and clips to the screen. Spans and rectangles are
+// filled a byte at a time between the two partial end bytes, blits shift
+// each source byte into place instead of going pixel by pixel.
+#include "ch32v003_cvbs_graphics_128x96.h"
+
+typedef enum cvbs_graphics_128x96_op_e {
+	CVBS_GRAPHICS_128X96_SET,   // Source 1s turn pixels on
+	CVBS_GRAPHICS_128X96_CLEAR, // Source 1s turn pixels off
+	CVBS_GRAPHICS_128X96_XOR,   // Source 1s invert pixels
+	CVBS_GRAPHICS_128X96_COPY,  // Pixels take the source, 0s included
+} cvbs_graphics_128x96_op_t;
+
+void cvbs_graphics_128x96_pixel(cvbs_graphics_128x96_context_t *ctx, int x, int y, cvbs_graphics_128x96_op_t op);
+
+// Ends are inclusive, in any order.
+void cvbs_graphics_128x96_hline(cvbs_graphics_128x96_context_t *ctx, int x0, int x1, int y, cvbs_graphics_128x96_op_t op);
+void cvbs_graphics_128x96_vline(cvbs_graphics_128x96_context_t *ctx, int x, int y0, int y1, cvbs_graphics_128x96_op_t op);
+void cvbs_graphics_128x96_line(cvbs_graphics_128x96_context_t *ctx, int x0, int y0, int x1, int y1, cvbs_graphics_128x96_op_t op);
+
+void cvbs_graphics_128x96_rect(cvbs_graphics_128x96_context_t *ctx, int x, int y, int w, int h, cvbs_graphics_128x96_op_t op);
+void cvbs_graphics_128x96_fill_rect(cvbs_graphics_128x96_context_t *ctx, int x, int y, int w, int h, cvbs_graphics_128x96_op_t op);
+
+// 1bpp image, MSB at the left, rows `stride` bytes apart.
+void cvbs_graphics_128x96_blit(cvbs_graphics_128x96_context_t *ctx, int x, int y,
+	const uint8_t *src, int w, int h, int stride, cvbs_graphics_128x96_op_t op);
+
+// Text in 8x8 cells with a fonts/*.h table. Codes 128-255 are inverse video
+// on 128 glyph fonts, like in text mode. \n starts a new line at x. Returns
+// x after the last character.
+int cvbs_graphics_128x96_text(cvbs_graphics_128x96_context_t *ctx, int x, int y,
+	const uint8_t *font, const char *s, cvbs_graphics_128x96_op_t op);
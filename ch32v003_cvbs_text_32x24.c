@@ -7,25 +7,139 @@ static void on_vblank(cvbs_context_t *cvbs) {
 	if (!cvbs->line) cvbs_text->frame_counter++;
 }
 
-//
-static void on_scanline(cvbs_context_t *cvbs, cvbs_scanline_t *scanline) {
+#define RING_MASK (CVBS_TEXT_32X24_LINE_BUFFERS-1)
+_Static_assert(CVBS_TEXT_32X24_LINE_BUFFERS >= (CVBS_TEXT_32X24_RENDER_AHEAD ? 4 : 2) && !(CVBS_TEXT_32X24_LINE_BUFFERS & RING_MASK),
+	"Line buffers must be a power of 2, at least 2, or 4 with render-ahead");
+
+// Pixel rows of the whole screen, over both fields when interlaced.
+#define TEXT_LINES (CVBS_TEXT_32X24_ROWS*8)
+
+#if CVBS_TEXT_32X24_INTERLACED
+// Field 0 shows the even pixel rows, field 1 the odd ones.
+static inline unsigned frame_line(cvbs_context_t *cvbs) {
+	return cvbs->line*2 + cvbs->field;
+}
+
+static inline unsigned next_frame_line(unsigned line) {
+	line += 2;
+	return line < TEXT_LINES ? line : (line - TEXT_LINES) ^ 1;
+}
+#else
+static inline unsigned frame_line(cvbs_context_t *cvbs) {
+	return cvbs->line;
+}
+
+static inline unsigned next_frame_line(unsigned line) {
+	return line+1 < TEXT_LINES ? line+1 : 0;
+}
+#endif
+
+// Font row and VRAM row for a given pixel row.
+static inline void line_sources(cvbs_text_32x24_context_t *cvbs_text, unsigned line, const uint8_t **font, const uint8_t **src) {
+	if (!line)
+		cvbs_text->first_row_latched = cvbs_text->first_row;
+
+	unsigned row = line/8 + cvbs_text->first_row_latched;
+	if (row >= CVBS_TEXT_32X24_ROWS) row -= CVBS_TEXT_32X24_ROWS;
+
+	*font = cvbs_text->active_font+1 + ((line%8) << *cvbs_text->active_font);/////// ASCII
+	*src  = cvbs_text->VRAM + row*32;
+}
+
+// Common part of all kernels: pick line buffer, font row and VRAM row.
+static inline uint8_t *scanline_begin(cvbs_context_t *cvbs, const uint8_t **font, const uint8_t **src) {
 	cvbs_text_32x24_context_t *cvbs_text = container_of(cvbs, cvbs_text_32x24_context_t, cvbs);
-	uint8_t *img  = cvbs->line&1 ? cvbs_text->VRAM1 : cvbs_text->VRAM0;
-	const uint8_t *font = cvbs_text->active_font+1 + ((cvbs->line%8) << *cvbs_text->active_font);/////// ASCII
-	const uint8_t *src  = cvbs_text->VRAM + cvbs->line/8*32;
+	line_sources(cvbs_text, frame_line(cvbs), font, src);
+	return cvbs_text->line_buffer[cvbs->line&1];
+}
 
-	#if 0 // Loopy code, ISR takes ~1175 cycles.
-	for (int i=0; i<32; i++) {
-		img[i] = font[src[i] & 0x7F] ^ (src[i]&0x80 ? 0xFF : 0);
-	}
-	#elif 1 // Partially unrolled, ISR takes ~800 cycles, costs +76 .text bytes.
+static inline void scanline_end(cvbs_context_t *cvbs, cvbs_scanline_t *scanline, uint8_t *img) {
+	img[32] = 0;
+
+	memset(scanline, 0, sizeof(*scanline));
+	scanline->horizontal_start = cvbs_horizontal_start(cvbs);
+	scanline->data_length = 33;
+	scanline->data = img;
+}
+
+// Byte at a time, 4 characters per iteration.
+static inline void render_unroll4(uint8_t *img, const uint8_t *font, const uint8_t *src) {
 	for (int i=0; i<32; i+=4) {
 		img[i+0] = font[src[i+0] & 0x7F] ^ (src[i+0]&0x80 ? 0xFF : 0);
 		img[i+1] = font[src[i+1] & 0x7F] ^ (src[i+1]&0x80 ? 0xFF : 0);
 		img[i+2] = font[src[i+2] & 0x7F] ^ (src[i+2]&0x80 ? 0xFF : 0);
 		img[i+3] = font[src[i+3] & 0x7F] ^ (src[i+3]&0x80 ? 0xFF : 0);
 	}
-	#else // Fully unrolled, ISR takes ~722 cycles, costs +836 .text bytes.
+}
+
+// Same for fonts with 256 glyphs per row, 128-255 pre-inverted, so each
+// character is a pure table lookup.
+static inline void render_unroll4_inverted(uint8_t *img, const uint8_t *font, const uint8_t *src) {
+	for (int i=0; i<32; i+=4) {
+		img[i+0] = font[src[i+0]];
+		img[i+1] = font[src[i+1]];
+		img[i+2] = font[src[i+2]];
+		img[i+3] = font[src[i+3]];
+	}
+}
+
+// With user glyphs, characters go through a pointer per range of 16 codes,
+// one of which points at the glyph bank instead of the font. Inverse is done
+// like render_unroll4(), so any font works.
+static inline void render_unroll4_user(uint8_t *img, const uint8_t * const *ranges, const uint8_t *src) {
+	for (int i=0; i<32; i+=4) {
+		img[i+0] = ranges[src[i+0] >> 4 & 7][src[i+0] & 15] ^ (src[i+0]&0x80 ? 0xFF : 0);
+		img[i+1] = ranges[src[i+1] >> 4 & 7][src[i+1] & 15] ^ (src[i+1]&0x80 ? 0xFF : 0);
+		img[i+2] = ranges[src[i+2] >> 4 & 7][src[i+2] & 15] ^ (src[i+2]&0x80 ? 0xFF : 0);
+		img[i+3] = ranges[src[i+3] >> 4 & 7][src[i+3] & 15] ^ (src[i+3]&0x80 ? 0xFF : 0);
+	}
+}
+
+// Picks the renderer from the font header, one branch per line.
+static inline void render_line(cvbs_text_32x24_context_t *cvbs_text, uint8_t *img, unsigned line) {
+	const uint8_t *font, *src;
+	line_sources(cvbs_text, line, &font, &src);
+
+	if (cvbs_text->user_glyphs) {
+		const uint8_t *ranges[8];
+		for (int i=0; i<8; i++)
+			ranges[i] = font + 16*i;
+		ranges[cvbs_text->user_glyphs_code >> 4] = cvbs_text->user_glyphs->rows[line%8];
+		render_unroll4_user(img, ranges, src);
+	} else if (*cvbs_text->active_font == 8)
+		render_unroll4_inverted(img, font, src);
+	else
+		render_unroll4(img, font, src);
+}
+
+// Partially unrolled, ISR takes ~800 cycles, costs +76 .text bytes.
+static void on_scanline_unroll4(cvbs_context_t *cvbs, cvbs_scanline_t *scanline) {
+	cvbs_text_32x24_context_t *cvbs_text = container_of(cvbs, cvbs_text_32x24_context_t, cvbs);
+	uint8_t *img = cvbs_text->line_buffer[cvbs->line&1];
+
+	render_line(cvbs_text, img, frame_line(cvbs));
+
+	scanline_end(cvbs, scanline, img);
+}
+
+#if CVBS_ALL_KERNELS
+// Loopy code, ISR takes ~1175 cycles.
+static void on_scanline_loop(cvbs_context_t *cvbs, cvbs_scanline_t *scanline) {
+	const uint8_t *font, *src;
+	uint8_t *img = scanline_begin(cvbs, &font, &src);
+
+	for (int i=0; i<32; i++) {
+		img[i] = font[src[i] & 0x7F] ^ (src[i]&0x80 ? 0xFF : 0);
+	}
+
+	scanline_end(cvbs, scanline, img);
+}
+
+// Fully unrolled, ISR takes ~722 cycles, costs +836 .text bytes.
+static void on_scanline_unroll32(cvbs_context_t *cvbs, cvbs_scanline_t *scanline) {
+	const uint8_t *font, *src;
+	uint8_t *img = scanline_begin(cvbs, &font, &src);
+
 	int i=0;
 	img[i] = font[src[i] & 0x7F] ^ (src[i]&0x80 ? 0xFF : 0); i++;
 	img[i] = font[src[i] & 0x7F] ^ (src[i]&0x80 ? 0xFF : 0); i++;
@@ -59,64 +173,194 @@ static void on_scanline(cvbs_context_t *cvbs, cvbs_scanline_t *scanline) {
 	img[i] = font[src[i] & 0x7F] ^ (src[i]&0x80 ? 0xFF : 0); i++;
 	img[i] = font[src[i] & 0x7F] ^ (src[i]&0x80 ? 0xFF : 0); i++;
 	img[i] = font[src[i] & 0x7F] ^ (src[i]&0x80 ? 0xFF : 0); i++;
-	#endif
-	img[32] = 0;
 
-	const cvbs_pulse_properties_t *pp = cvbs->pulse_properties;
-	memset(scanline, 0, sizeof(*scanline));
-	scanline->horizontal_start = (int)(5.7e-6*48e6) + pp->sync_normal;
-	scanline->data_length = 33;
-	scanline->data = img;
+	scanline_end(cvbs, scanline, img);
 }
+#endif // CVBS_ALL_KERNELS
 
-#if !FUNCONF_USE_DEBUGPRINTF
-int putchar(int c) {
-	cvbs_context_t *cvbs = cvbs_get_active_context();
+// Entry 0 is the default. Alternatives cost flash, so they are only linked in
+// for benchmarking, see cvbs_bench.h.
+const cvbs_kernel_t cvbs_text_32x24_kernels[] = {
+	{ "unroll4", on_scanline_unroll4 },
+#if CVBS_ALL_KERNELS
+	{ "loop", on_scanline_loop },
+	{ "unroll32", on_scanline_unroll32 },
+#endif
+	{ 0 }
+};
+
+#if CVBS_TEXT_32X24_RENDER_AHEAD
+// Render-ahead consumer, only hands a ready line buffer to DMA.
+static void on_scanline_ring(cvbs_context_t *cvbs, cvbs_scanline_t *scanline) {
+	static const uint8_t blank[1];
 	cvbs_text_32x24_context_t *cvbs_text = container_of(cvbs, cvbs_text_32x24_context_t, cvbs);
-	uint32_t *pos = &cvbs_text->cursor_position;
+	uint8_t head = cvbs_text->ring_head;
+	uint8_t tail = cvbs_text->ring_tail;
 
-	switch(c) {
-		case '\f':
-			memset(cvbs_text->VRAM, ' ', sizeof(cvbs_text->VRAM));
-			*pos = 0;
-			break;
+	// Drop stale lines, left over from an earlier underrun.
+	unsigned line = frame_line(cvbs);
+	while (tail != head && cvbs_text->ring_line[tail & RING_MASK] != line)
+		tail++;
 
-		case '\r':
-			*pos = *pos/32*32;
-			break;
+	memset(scanline, 0, sizeof(*scanline));
+	scanline->horizontal_start = cvbs_horizontal_start(cvbs);
 
-		case '\n':
-			*pos = *pos/32*32+32;
-			break;
+	cvbs_text->ring_busy[1] = cvbs_text->ring_busy[0];
+	if (tail == head) {
+		cvbs_text->ring_busy[0] = 0xFF;
+		cvbs_text->ring_resync = next_frame_line(line);
+		cvbs_text->ring_underruns++;
+		scanline->data_length = 1;
+		scanline->data = blank;
+	} else {
+		cvbs_text->ring_busy[0] = tail & RING_MASK;
+		scanline->data_length = 33;
+		scanline->data = cvbs_text->line_buffer[tail & RING_MASK];
+		tail++;
+	}
+	cvbs_text->ring_tail = tail;
+}
 
-		case '\b':
-			if (*pos & 31) (*pos)--;
+int cvbs_text_32x24_render_ahead(cvbs_text_32x24_context_t *cvbs_text) {
+	int n = 0;
+
+	// After an underrun, restart just ahead of the beam.
+	uint32_t underruns = cvbs_text->ring_underruns;
+	if (underruns != cvbs_text->ring_underruns_seen) {
+		cvbs_text->ring_underruns_seen = underruns;
+		cvbs_text->render_line = cvbs_text->ring_resync;
+	}
+
+	while (true) {
+		uint8_t head = cvbs_text->ring_head;
+		uint8_t slot = head & RING_MASK;
+		if ((uint8_t)(head - cvbs_text->ring_tail) >= CVBS_TEXT_32X24_LINE_BUFFERS)
 			break;
+		if (slot == cvbs_text->ring_busy[0] || slot == cvbs_text->ring_busy[1])
+			break;
+
+		uint8_t *img = cvbs_text->line_buffer[slot];
+		render_line(cvbs_text, img, cvbs_text->render_line);
+		img[32] = 0;
+
+		cvbs_text->ring_line[slot] = cvbs_text->render_line;
+		cvbs_text->render_line = next_frame_line(cvbs_text->render_line);
+		cvbs_text->ring_head = head+1;
+		n++;
+	}
+
+	return n;
+}
+
+void cvbs_text_32x24_enable_render_ahead(cvbs_text_32x24_context_t *cvbs_text) {
+	cvbs_text->ring_head = 0;
+	cvbs_text->ring_tail = 0;
+	cvbs_text->ring_busy[0] = 0xFF;
+	cvbs_text->ring_busy[1] = 0xFF;
+	cvbs_text->ring_resync = 0;
+	cvbs_text->ring_underruns = 0;
+	cvbs_text->ring_underruns_seen = 0;
+	cvbs_text->render_line = 0;
+	cvbs_text->cvbs.on_scanline = on_scanline_ring;
+}
+#endif // CVBS_TEXT_32X24_RENDER_AHEAD
+
+void cvbs_text_32x24_define_glyph(cvbs_text_32x24_glyphs_t *glyphs, unsigned index, const uint8_t bitmap[8]) {
+	for (int r=0; r<8; r++)
+		glyphs->rows[r][index & 15] = bitmap[r];
+}
+
+void cvbs_text_32x24_scroll(cvbs_text_32x24_context_t *ctx) {
+	memset(cvbs_text_32x24_row(ctx, 0), ' ', 32);
+	ctx->first_row = ctx->first_row+1 < CVBS_TEXT_32X24_ROWS ? ctx->first_row+1 : 0;
+}
+
+// Copies printable characters at the cursor, one memcpy per screen row.
+static uint32_t write_run(cvbs_text_32x24_context_t *cvbs_text, uint32_t pos, const char *buf, int size) {
+	while (size) {
+		while (pos >= sizeof(cvbs_text->VRAM)) {
+			cvbs_text_32x24_scroll(cvbs_text);
+			pos -= 32;
+		}
+
+		int n = 32 - pos%32;
+		if (n > size) n = size;
+		memcpy(cvbs_text_32x24_row(cvbs_text, pos/32) + pos%32, buf, n);
+		pos += n;
+		buf += n;
+		size -= n;
+	}
+	return pos;
+}
 
-		case '\t':
-			while(*pos % 3) putchar(' ');
+// Control characters handled by the console, all others are glyphs.
+static inline bool is_control(char c) {
+	return c == '\f' || c == '\r' || c == '\n' || c == '\b' || c == '\t';
+}
+
+int cvbs_text_32x24_write(cvbs_text_32x24_context_t *cvbs_text, const char *buf, int size) {
+	const char *end = buf + size;
+	uint32_t pos = cvbs_text->cursor_position;
+
+	while (buf < end) {
+		const char *run = buf;
+		while (buf < end && !is_control(*buf))
+			buf++;
+		pos = write_run(cvbs_text, pos, run, buf - run);
+
+		if (buf == end)
 			break;
 
-		default:
-			while (*pos >= sizeof(cvbs_text->VRAM)) {
-				memmove(cvbs_text->VRAM, cvbs_text->VRAM+32, sizeof(cvbs_text->VRAM)-32);
-				memset(cvbs_text->VRAM + sizeof(cvbs_text->VRAM) - 32, ' ', 32);
-				*pos -= 32;
-			}
-			cvbs_text->VRAM[(*pos)++] = c;
+		switch(*buf++) {
+			case '\f':
+				memset(cvbs_text->VRAM, ' ', sizeof(cvbs_text->VRAM));
+				cvbs_text->first_row = 0;
+				pos = 0;
+				break;
+
+			case '\r':
+				pos = pos/32*32;
+				break;
+
+			case '\n':
+				pos = pos/32*32+32;
+				break;
+
+			case '\b':
+				if (pos & 31) pos--;
+				break;
+
+			case '\t':
+				if (pos % 3)
+					pos = write_run(cvbs_text, pos, "  ", 3 - pos%3);
+				break;
+		}
 	}
+
+	cvbs_text->cursor_position = pos;
+	return size;
+}
+
+#if !FUNCONF_USE_DEBUGPRINTF
+int putchar(int c) {
+	cvbs_context_t *cvbs = cvbs_get_active_context();
+	cvbs_text_32x24_context_t *cvbs_text = container_of(cvbs, cvbs_text_32x24_context_t, cvbs);
+	char ch = c;
+	cvbs_text_32x24_write(cvbs_text, &ch, 1);
 	return 0;
 }
 
 int _write(int fd, const char *buf, int size) {
-	while (size--) putchar(*buf++);
-	return 0;
+	cvbs_context_t *cvbs = cvbs_get_active_context();
+	cvbs_text_32x24_context_t *cvbs_text = container_of(cvbs, cvbs_text_32x24_context_t, cvbs);
+	return cvbs_text_32x24_write(cvbs_text, buf, size);
 }
 #endif // !FUNCONF_USE_DEBUGPRINTF
 
-void cvbs_text_32x24_context_init(cvbs_text_32x24_context_t *cvbs_text) {
+void cvbs_text_32x24_context_init(cvbs_text_32x24_context_t *cvbs_text, cvbs_standard_t standard) {
 	memset(cvbs_text, 0, sizeof(*cvbs_text));
-	cvbs_context_init(&cvbs_text->cvbs, CVBS_STD_ZX81_NTSC);
-	cvbs_text->cvbs.on_scanline = on_scanline;
+	cvbs_context_init(&cvbs_text->cvbs, standard);
+	cvbs_context_set_lines(&cvbs_text->cvbs, 24*8); // Per field, interlaced or not
+	cvbs_text->cvbs.on_scanline = cvbs_text_32x24_kernels[0].on_scanline;
 	cvbs_text->cvbs.on_vblank = on_vblank;
 }
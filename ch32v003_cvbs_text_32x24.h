@@ -1,6 +1,32 @@
 #pragma once
 #include <ch32v003_cvbs.h>
 
+// Render-ahead, see cvbs_text_32x24_enable_render_ahead(). Off by default,
+// its ring needs 2 more line buffers, 72 bytes of SRAM.
+#ifndef CVBS_TEXT_32X24_RENDER_AHEAD
+#define CVBS_TEXT_32X24_RENDER_AHEAD 0
+#endif
+
+// Line buffers, 2 for double buffering, or the depth of the render-ahead
+// ring. Power of 2, at least 4 with render-ahead.
+#ifndef CVBS_TEXT_32X24_LINE_BUFFERS
+#define CVBS_TEXT_32X24_LINE_BUFFERS (CVBS_TEXT_32X24_RENDER_AHEAD ? 4 : 2)
+#endif
+
+// High resolution: 48 rows over the two fields of an interlaced standard,
+// CVBS_STD_PAL or CVBS_STD_NTSC, each field showing every other pixel row.
+// Same pixels per line, twice the rows, and twice the VRAM, 1536 bytes.
+#ifndef CVBS_TEXT_32X24_INTERLACED
+#define CVBS_TEXT_32X24_INTERLACED 0
+#endif
+#define CVBS_TEXT_32X24_ROWS (CVBS_TEXT_32X24_INTERLACED ? 48 : 24)
+
+// A bank of 16 user-defined glyphs, mapped over 16 consecutive codes. Stored
+// by rows like a font, so row r of glyph g is rows[r][g], MSB at the left.
+typedef struct cvbs_text_32x24_glyphs_s {
+    uint8_t rows[8][16];
+} cvbs_text_32x24_glyphs_t;
+
 typedef struct cvbs_text_32x24_context_s {
     cvbs_context_t cvbs;
     uint32_t frame_counter;
@@ -8,15 +34,73 @@ typedef struct cvbs_text_32x24_context_s {
 
     const uint8_t *active_font;
 
-    uint8_t VRAM0[36];
-    uint8_t VRAM1[36];
-    uint8_t VRAM[32*24];
+    // Optional, shown instead of the font's glyphs for codes user_glyphs_code
+    // to user_glyphs_code+15, and their inverse, see cvbs_text_32x24_set_user_glyphs().
+    const cvbs_text_32x24_glyphs_t *user_glyphs;
+    uint8_t user_glyphs_code;
+
+    // VRAM is a circular buffer of rows, first_row is shown at the top.
+    // Sampled when line 0 is rendered, so a scroll never tears a frame.
+    volatile uint8_t first_row;
+    uint8_t first_row_latched;
+
+#if CVBS_TEXT_32X24_RENDER_AHEAD
+    // Render-ahead ring, see cvbs_text_32x24_render_ahead()
+    volatile uint8_t ring_head;     // Advanced by the producer
+    volatile uint8_t ring_tail;     // Advanced by on_scanline
+    volatile uint8_t ring_busy[2];  // Slots in DMA now, and armed for next line
+    volatile uint16_t ring_resync;  // Line the producer should restart from
+    volatile uint32_t ring_underruns;
+    uint32_t ring_underruns_seen;
+    uint16_t render_line;           // Next line the producer renders
+    uint16_t ring_line[CVBS_TEXT_32X24_LINE_BUFFERS];
+#endif
+
+    uint8_t line_buffer[CVBS_TEXT_32X24_LINE_BUFFERS][36];
+    uint8_t VRAM[32*CVBS_TEXT_32X24_ROWS];
 } cvbs_text_32x24_context_t;
 
 static inline void cvbs_text_32x24_wait_for_vsync(cvbs_text_32x24_context_t *ctx) {
-    volatile uint32_t *is = &ctx->frame_counter;
-	unsigned was = *is;
-	while (was == *is);
+    cvbs_wait_for_change(&ctx->frame_counter);
+}
+
+// VRAM row shown at screen row `row`, accounting for scrolling.
+static inline uint8_t *cvbs_text_32x24_row(cvbs_text_32x24_context_t *ctx, unsigned row) {
+    row += ctx->first_row;
+    if (row >= CVBS_TEXT_32X24_ROWS) row -= CVBS_TEXT_32X24_ROWS;
+    return ctx->VRAM + row*32;
 }
 
-void cvbs_text_32x24_context_init(cvbs_text_32x24_context_t *cvbs_text);
+// Scrolls up by one row: clears the top row, which becomes the bottom one.
+void cvbs_text_32x24_scroll(cvbs_text_32x24_context_t *ctx);
+
+// Console output at cursor_position, handles \f \r \n \b \t and scrolling.
+// Printable runs are copied a row at a time. Also backs printf().
+int cvbs_text_32x24_write(cvbs_text_32x24_context_t *ctx, const char *buf, int size);
+
+// Maps a glyph bank, in RAM or flash, over codes `code` to `code`+15. Code is
+// rounded down to a multiple of 16 below 128, NULL goes back to the font.
+static inline void cvbs_text_32x24_set_user_glyphs(cvbs_text_32x24_context_t *ctx, const cvbs_text_32x24_glyphs_t *glyphs, uint8_t code) {
+    ctx->user_glyphs_code = code & 0x70;
+    ctx->user_glyphs = glyphs;
+}
+
+// Stores an 8 byte glyph, top row first, as glyph `index` of a bank.
+void cvbs_text_32x24_define_glyph(cvbs_text_32x24_glyphs_t *glyphs, unsigned index, const uint8_t bitmap[8]);
+
+extern const cvbs_kernel_t cvbs_text_32x24_kernels[];
+
+#if CVBS_TEXT_32X24_RENDER_AHEAD
+// Render-ahead: lines are rendered outside the HSYNC ISR, into a ring of line
+// buffers, and the ISR only hands the next one to DMA. If a line is not ready
+// in time it is shown blank and counted in ring_underruns.
+void cvbs_text_32x24_enable_render_ahead(cvbs_text_32x24_context_t *cvbs_text);
+
+// Fills free ring slots, call often from the idle loop or a low priority
+// interrupt. Returns the number of lines rendered.
+int cvbs_text_32x24_render_ahead(cvbs_text_32x24_context_t *cvbs_text);
+#endif
+
+// The 192 lines are centered in the standard's active lines. Interlaced
+// builds need an interlaced standard.
+void cvbs_text_32x24_context_init(cvbs_text_32x24_context_t *cvbs_text, cvbs_standard_t standard);
@@ -0,0 +1,85 @@
+#include "ch32v003_cvbs_viewport.h"
+#include "container_of.h"
+#include <string.h>
+
+// SYSCLK cycles per pixel at 3MHz.
+#define CYCLES_PER_PIXEL (48/3)
+
+static void on_vblank(cvbs_context_t *cvbs) {
+	cvbs_viewport_context_t *ctx = container_of(cvbs, cvbs_viewport_context_t, cvbs);
+	if (!cvbs->line)
+		ctx->frame_counter++;
+	if (!cvbs_is_last_blank_line(cvbs))
+		return;
+
+	// Once per frame, so the multiply is fine here.
+	unsigned x = ctx->scroll_x;
+	unsigned y = ctx->scroll_y;
+	while (x >= ctx->width) x -= ctx->width;
+	while (y >= ctx->height) y -= ctx->height;
+	ctx->first_row = ctx->bitmap + y * (ctx->width/8);
+	ctx->end = ctx->bitmap + ctx->height * (ctx->width/8);
+	ctx->column = x/8;
+	ctx->fine = x%8;
+}
+
+// Copies the 17 bytes under the window, masks the pixels shifted past either
+// edge by the fine scroll, and ends the line with a zero byte.
+static void copy_row(cvbs_viewport_context_t *ctx, uint8_t *line) {
+	unsigned stride = ctx->width/8;
+	unsigned n = stride - ctx->column;
+	if (n >= 17) {
+		memcpy(line, ctx->row + ctx->column, 17);
+	} else {
+		memcpy(line, ctx->row + ctx->column, n);
+		memcpy(line + n, ctx->row, 17 - n);
+	}
+
+	uint8_t mask = 0xFF >> ctx->fine;
+	line[0] &= mask;
+	line[16] &= ~mask;
+	line[17] = 0;
+}
+
+// Each row is shown on two consecutive lines, copied on the first one. Fine
+// scroll starts the line early, by whole pixels, instead of shifting bits.
+static void on_scanline(cvbs_context_t *cvbs, cvbs_scanline_t *scanline) {
+	cvbs_viewport_context_t *ctx = container_of(cvbs, cvbs_viewport_context_t, cvbs);
+	unsigned y = cvbs->line/2;
+	uint8_t *line = ctx->line_buffer[y&1];
+
+	if (!(cvbs->line & 1)) {
+		if (!y) {
+			ctx->row = ctx->first_row;
+		} else {
+			ctx->row += ctx->width/8;
+			if (ctx->row >= ctx->end)
+				ctx->row = ctx->bitmap;
+		}
+		copy_row(ctx, line);
+	}
+
+	scanline->horizontal_start = cvbs_horizontal_start(cvbs) - ctx->fine * CYCLES_PER_PIXEL;
+	scanline->data_length = sizeof(ctx->line_buffer[0]);
+	scanline->data = line;
+	scanline->flags.pixel_clock_12M = 0;
+	scanline->flags.pixel_clock_3M = 1;
+}
+
+const cvbs_kernel_t cvbs_viewport_kernels[] = {
+	{ "window", on_scanline },
+	{ 0 }
+};
+
+void cvbs_viewport_context_init(cvbs_viewport_context_t *ctx, cvbs_standard_t standard, const uint8_t *bitmap, uint16_t width, uint16_t height) {
+	memset(ctx, 0, sizeof(*ctx));
+	cvbs_context_init(&ctx->cvbs, standard);
+	cvbs_context_set_lines(&ctx->cvbs, 96*2);
+	ctx->cvbs.on_scanline = cvbs_viewport_kernels[0].on_scanline;
+	ctx->cvbs.on_vblank = on_vblank;
+	ctx->bitmap = bitmap;
+	ctx->width = width;
+	ctx->height = height;
+	ctx->first_row = bitmap;
+	ctx->end = bitmap + height * (width/8);
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <ch32v003_cvbs.h>
+
+// A 128x96 window, same pixels as the graphics mode, over a larger virtual
+// bitmap in RAM or flash. The bitmap wraps around in both directions.
+typedef struct cvbs_viewport_context_s {
+	cvbs_context_t cvbs;
+	uint32_t frame_counter;
+
+	// Rows of width/8 bytes, MSB at the left, no guard bytes needed.
+	const uint8_t *bitmap;
+	uint16_t width;  // Pixels, multiple of 8, at least 128
+	uint16_t height; // Rows
+
+	// Top left pixel of the window. Latched on the last blank line, so set
+	// them any time during the frame before.
+	volatile uint16_t scroll_x;
+	volatile uint16_t scroll_y;
+
+	// Kernel state: latched window, and the row being shown.
+	const uint8_t *first_row;
+	const uint8_t *end;
+	const uint8_t *row;
+	uint16_t column;
+	uint8_t fine;
+	uint8_t line_buffer[2][18];
+} cvbs_viewport_context_t;
+
+static inline void cvbs_viewport_wait_for_vsync(cvbs_viewport_context_t *ctx) {
+	cvbs_wait_for_change(&ctx->frame_counter);
+}
+
+extern const cvbs_kernel_t cvbs_viewport_kernels[];
+
+// The 192 lines are centered in the standard's active lines.
+void cvbs_viewport_context_init(cvbs_viewport_context_t *ctx, cvbs_standard_t standard, const uint8_t *bitmap, uint16_t width, uint16_t height);
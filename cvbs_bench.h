@@ -0,0 +1,143 @@
+#pragma once
+// Cycle-budget benchmark for on_scanline kernels.
+//
+// Walks one full frame of the context's pulse sequence with the video ISR
+// stopped, timing every on_scanline call. On target the clock is SysTick at
+// HCLK, so results are CPU cycles. The host build supplies its own clock, see
+// host/host_bench.c.
+//
+// Build with CVBS_ALL_KERNELS=1 to link every kernel variant, not only the
+// default one.
+
+#include "ch32v003fun.h"
+#include "ch32v003_cvbs.h"
+#include "ch32v003_cvbs_format.h"
+
+#ifndef cvbs_bench_clock
+#define cvbs_bench_clock() ((uint32_t)SysTick->CNT)
+#endif
+
+typedef struct cvbs_bench_result_s {
+	const char *name;
+	uint32_t lines;      // Active lines timed
+	uint32_t total;      // Sum over all lines
+	uint32_t best;       // Cheapest line
+	uint32_t worst;      // Most expensive line
+	int worst_line;      // cvbs_context_t::line of the worst line
+} cvbs_bench_result_t;
+
+// Cost of reading the clock twice, subtracted from every sample.
+static uint32_t cvbs_bench_overhead() {
+	uint32_t best = UINT32_MAX;
+	for (int i=0; i<8; i++) {
+		uint32_t t = cvbs_bench_clock();
+		t = cvbs_bench_clock() - t;
+		if (t < best) best = t;
+	}
+	return best;
+}
+
+// Times ctx->on_scanline over one frame.
+static void cvbs_bench_frame(cvbs_context_t *ctx, cvbs_bench_result_t *res) {
+	static cvbs_scanline_t scanline;
+	const cvbs_pulse_t *seq = ctx->pulse_properties->pulse_sequence;
+	uint32_t overhead = cvbs_bench_overhead();
+
+	res->lines = 0;
+	res->total = 0;
+	res->best = UINT32_MAX;
+	res->worst = 0;
+	res->worst_line = -1;
+
+	// Rewind to the start of the sequence, then step like the ISR does.
+	ctx->pulse_index = 0;
+	ctx->current_pulse = seq[0];
+	ctx->pulse_counter = seq[0].duration;
+	ctx->line = 0;
+
+	unsigned frame_lines = 0;
+	for (const cvbs_pulse_t *p = seq; p->duration; p++)
+		frame_lines += p->duration;
+
+	while (frame_lines--) {
+		cvbs_step(ctx);
+		// Lines around the mode's are sent blank by the ISR, see scanline_step().
+		if (!cvbs_is_active_line(ctx) || (unsigned)ctx->line >= ctx->lines)
+			continue;
+
+		uint32_t t = cvbs_bench_clock();
+		ctx->on_scanline(ctx, &scanline);
+		t = cvbs_bench_clock() - t - overhead;
+
+		res->lines++;
+		res->total += t;
+		if (t < res->best) res->best = t;
+		if (t > res->worst) {
+			res->worst = t;
+			res->worst_line = ctx->line;
+		}
+	}
+}
+
+// Times every kernel in a null-terminated table, one frame each, up to `max`
+// of them. Stops the video ISR if ctx is being displayed, so expect the TV to
+// resync. Returns the number of results written.
+static int cvbs_bench_kernels(cvbs_context_t *ctx, const cvbs_kernel_t *kernels, cvbs_bench_result_t *res, int max) {
+	bool running = cvbs_get_active_context() == ctx;
+	if (running)
+		NVIC_DisableIRQ(TIM1_UP_IRQn);
+
+	cvbs_context_t saved = *ctx;
+	int n = 0;
+	for (; n < max && kernels[n].on_scanline; n++) {
+		ctx->on_scanline = kernels[n].on_scanline;
+		cvbs_bench_frame(ctx, &res[n]);
+		res[n].name = kernels[n].name;
+	}
+	*ctx = saved;
+
+	if (running)
+		NVIC_EnableIRQ(TIM1_UP_IRQn);
+	return n;
+}
+
+// A space, then v right aligned in 5 columns, with the division-free
+// formatters of ch32v003_cvbs_format.h instead of printf.
+static void cvbs_bench_print_column(int32_t v, int (*write)(const char *buf, int size)) {
+	char buf[CVBS_FORMAT_MAX];
+	int n = cvbs_format_i32(buf, v);
+	for (int i=n; i<6; i++)
+		write(" ", 1);
+	write(buf, n);
+}
+
+// Prints a result table through any write function, a wrapper around
+// cvbs_text_32x24_write() on target. Budget is the line period in the same
+// clock units, or 0 to skip the headroom column.
+static void cvbs_bench_print(const cvbs_bench_result_t *res, int n, uint32_t budget, int (*write)(const char *buf, int size)) {
+	static const char header[] = "kernel     mean  best worst  line  free\n";
+	if (budget)
+		write(header, sizeof(header)-1);
+	else {
+		write(header, sizeof(header)-8);
+		write("\n", 1);
+	}
+
+	for (int i=0; i<n; i++) {
+		const cvbs_bench_result_t *r = &res[i];
+		int name = 0;
+		while (r->name[name])
+			name++;
+		write(r->name, name);
+		for (; name<9; name++)
+			write(" ", 1);
+
+		cvbs_bench_print_column(r->lines ? r->total / r->lines : 0, write);
+		cvbs_bench_print_column(r->best, write);
+		cvbs_bench_print_column(r->worst, write);
+		cvbs_bench_print_column(r->worst_line, write);
+		if (budget)
+			cvbs_bench_print_column((int32_t)budget - (int32_t)r->worst, write);
+		write("\n", 1);
+	}
+}
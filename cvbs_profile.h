@@ -0,0 +1,87 @@
+#pragma once
+// Report for the ISR profiler, see CVBS_PROFILE in ch32v003_cvbs.h.
+//
+// Prints a snapshot through any write function, uart_write() from
+// uart_dma.h to dump it over UART, or a wrapper around
+// cvbs_text_32x24_write() to show it on screen. Formatting is only done here,
+// the ISR just counts. It uses the division-free formatters of
+// ch32v003_cvbs_format.h, not printf, to keep newlib's out of the firmware.
+
+#include "ch32v003_cvbs.h"
+#include "ch32v003_cvbs_format.h"
+
+#if CVBS_PROFILE
+// total/count by shift and subtract, the libgcc 64 bit divide is large and
+// slow on RV32EC. The mean is a duration, so it fits 32 bits.
+static uint32_t cvbs_profile_mean(const cvbs_profile_class_t *c) {
+	if (!c->count)
+		return 0;
+	uint32_t rem = c->total >> 32, lo = c->total, q = 0;
+	for (int i=0; i<32; i++) {
+		uint32_t carry = rem >> 31;
+		rem = rem << 1 | lo >> 31;
+		lo <<= 1;
+		q <<= 1;
+		if (carry || rem >= c->count) {
+			rem -= c->count;
+			q |= 1;
+		}
+	}
+	return q;
+}
+
+// A space, then the n characters of buf right aligned in `width` columns.
+static void cvbs_profile_print_column(const char *buf, int n, int width, int (*write)(const char *buf, int size)) {
+	write(" ", 1);
+	for (int i=n; i<width; i++)
+		write(" ", 1);
+	write(buf, n);
+}
+
+static void cvbs_profile_print_u32(uint32_t v, int width, int (*write)(const char *buf, int size)) {
+	char buf[CVBS_FORMAT_MAX];
+	cvbs_profile_print_column(buf, cvbs_format_u32(buf, v), width, write);
+}
+
+static void cvbs_profile_print_i32(int32_t v, int width, int (*write)(const char *buf, int size)) {
+	char buf[CVBS_FORMAT_MAX];
+	cvbs_profile_print_column(buf, cvbs_format_i32(buf, v), width, write);
+}
+
+static void cvbs_profile_print_class(const char *name, const cvbs_profile_class_t *c, int (*write)(const char *buf, int size)) {
+	int n = 0;
+	while (name[n])
+		n++;
+	write(name, n);
+	for (; n<6; n++)
+		write(" ", 1);
+
+	cvbs_profile_print_u32(c->count, 7, write);
+	cvbs_profile_print_u32(c->count ? c->min : 0, 5, write);
+	cvbs_profile_print_u32(cvbs_profile_mean(c), 5, write);
+	cvbs_profile_print_u32(c->max, 5, write);
+	cvbs_profile_print_i32(c->worst_line, 4, write);
+	write("\n", 1);
+
+	write("  bins of", 9);
+	cvbs_profile_print_u32(1 << CVBS_PROFILE_BIN_SHIFT, 0, write);
+	write(":", 1);
+	for (int i=0; i<CVBS_PROFILE_BINS; i++)
+		cvbs_profile_print_u32(c->histogram[i], 0, write);
+	write("\n", 1);
+}
+
+// Lines, min/mean/max cycles, worst line, then a histogram per line class,
+// one bin per 1<<CVBS_PROFILE_BIN_SHIFT cycles, and the overrun count.
+static void cvbs_profile_print(const cvbs_profile_t *p, int (*write)(const char *buf, int size)) {
+	static const char header[] = "class    lines   min  mean   max line\n";
+	write(header, sizeof(header)-1);
+	cvbs_profile_print_class("active", &p->active, write);
+	cvbs_profile_print_class("blank", &p->blank, write);
+	write("overruns", 8);
+	cvbs_profile_print_u32(p->overruns, 0, write);
+	write(", last line", 11);
+	cvbs_profile_print_i32(p->overrun_line, 0, write);
+	write("\n", 1);
+}
+#endif
@@ -142,12 +142,21 @@ def get_byte_for(code, line):
         val //= 2
     return res
 
-out = "static const uint8_t ascii_font[] = {\n"
-out += "7, // shift, 2**7 glyphs\n"
+# --inverted emits 256 glyphs per row, 128-255 being inverted copies of 0-127.
+inverted = "--inverted" in sys.argv
+name = "ascii_inverted" if inverted else "ascii"
+
+out = f"static const uint8_t {name}_font[] = {{\n"
+if inverted:
+    out += "8, // shift, 2**8 glyphs, upper half inverted\n"
+else:
+    out += "7, // shift, 2**7 glyphs\n"
 for line in range(8):
-    for code in range(128):
-        out += f'\t0x{get_byte_for(code, line):02x},\n'
+    for code in range(256 if inverted else 128):
+        val = get_byte_for(code & 0x7F, line)
+        if code & 0x80: val ^= 0xFF
+        out += f'\t0x{val:02x},\n'
 out += "};\n"
 
-with open("ascii.h","w") as f:
+with open(f"{name}.h","w") as f:
     f.write(out)
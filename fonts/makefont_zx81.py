@@ -14,12 +14,22 @@ def get_byte_for(code,  line):
         val = val*2 + (1 if pixels[x0+dx, y0] else 0)
     return val
 
-out = "static const uint8_t zx81_font[] = {\n"
-out += "\t6, // shift, 2**6 gliphs\n"
+# --inverted emits 256 glyphs per row, 128-255 being inverted copies of 0-127.
+# Codes 64-127 repeat 0-63, as there are only 64 glyphs.
+inverted = "--inverted" in sys.argv
+name = "zx81_inverted" if inverted else "zx81"
+
+out = f"static const uint8_t {name}_font[] = {{\n"
+if inverted:
+    out += "\t8, // shift, 2**8 gliphs, upper half inverted\n"
+else:
+    out += "\t6, // shift, 2**6 gliphs\n"
 for line in range(8):
-    for code in range(64):
-        out += f'\t{get_byte_for(code, line)},\n'
+    for code in range(256 if inverted else 64):
+        val = get_byte_for(code & 0x3F, line)
+        if code & 0x80: val ^= 0xFF
+        out += f'\t{val},\n'
 out += "};\n"
 
-with open("zx81.h","w") as f:
+with open(f"{name}.h","w") as f:
     f.write(out)
@@ -22,14 +22,23 @@ def get_byte_for(code,  line):
         val = val*2 + (1 if px!=215 else 0)
     return val
 
-out = "static const uint8_t zx81_ascii_font[] = {\n"
-out += "\t7, // shift, 2**6 gliphs\n"
+# --inverted emits 256 glyphs per row, 128-255 being inverted copies of 0-127.
+inverted = "--inverted" in sys.argv
+name = "zx81_ascii_inverted" if inverted else "zx81_ascii"
+
+out = f"static const uint8_t {name}_font[] = {{\n"
+if inverted:
+    out += "\t8, // shift, 2**8 gliphs, upper half inverted\n"
+else:
+    out += "\t7, // shift, 2**6 gliphs\n"
 for line in range(8):
-    for code in range(128):
-        out += f'\t{get_byte_for(code, line)},\n'
+    for code in range(256 if inverted else 128):
+        val = get_byte_for(code & 0x7F, line)
+        if code & 0x80: val ^= 0xFF
+        out += f'\t{val},\n'
 out += "};\n"
 
-with open("zx81_ascii.h","w") as f:
+with open(f"{name}.h","w") as f:
     f.write(out)
 
 print(cnt)
@@ -1,34 +1,32 @@
 #include "ch32v003_cvbs_graphics_128x96.h"
 
+static bool mandelbrot_gfx_get(void *target, int x, int y) {
+	return cvbs_graphics_128x96_get_pixel(target, x, y);
+}
+
+static void mandelbrot_gfx_set(void *target, int x, int y, bool on) {
+	cvbs_graphics_128x96_set_pixel(target, x, y, on);
+}
+
 void v81_mandelbrot_128x96(cvbs_graphics_128x96_context_t *gfx) {
 	// Start screen with checkerboard
 	for (unsigned line=0; line < 96; line+=2) {
-		memset(gfx->VRAM + 16*line +  0, 0x55, 16);
-		memset(gfx->VRAM + 16*line + 16, 0xAA, 16);
+		memset(cvbs_graphics_128x96_row(gfx, line+0), 0x55, 16);
+		memset(cvbs_graphics_128x96_row(gfx, line+1), 0xAA, 16);
 	}
 
 	mandelbrot_context_t ctx = {
 		96, 48,
-		1./64, 1./64,
+		MANDELBROT_FIXED(1./64), MANDELBROT_FIXED(1./64),
 		0
 	};
 
-	const unsigned HEIGHT = 96;
-	const unsigned WIDTH = 128;
-
-	for (int y=0; y<HEIGHT; y++) {
-		for (int x=0; x<WIDTH; x+=8) {
-			volatile uint8_t *vram = &gfx->VRAM[y*16 + x/8];
-
-			for (int dx=0; dx<8; dx++) {
-				int m = 0x80 >> dx;
-				if (mandlebrot_pixel(x+dx, y, &ctx))
-					*vram |= m;
-				else
-					*vram &= ~m;
-			}
-		}
-	}
+	mandelbrot_render_t r;
+	mandelbrot_render_init(&r, &ctx, 128, 96, gfx, mandelbrot_gfx_get, mandelbrot_gfx_set);
+	do {
+		cvbs_graphics_128x96_flip(gfx);
+	} while (!mandelbrot_render_step(&r, 48000*10));
+	cvbs_graphics_128x96_flip(gfx);
 
 	for (int i=0; i<60*5; i++)
 		cvbs_graphics_128x96_wait_for_vsync(gfx);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <string.h>
 #include "ch32v003_cvbs_text_32x24.h"
 
 #define HANOI_PIECES 9
@@ -32,6 +33,10 @@ typedef struct hanoi_context_s {
     uint8_t holding, holding_over;
 } hanoi_context_t;
 
+void hanoi_puts(hanoi_context_t *ctx, const char *s) {
+    cvbs_text_32x24_write(ctx->cvbs_text, s, strlen(s));
+}
+
 unsigned hanoi_bottom_piece(hanoi_context_t *ctx, int pin) {
     return ctx->towers[pin][0];
 }
@@ -164,11 +169,11 @@ void hanoi_print(hanoi_context_t *ctx) {
     hanoi_putc('\n',1);
     hanoi_print_pins(ctx);
 
-    printf("\n\n");
-    printf("towers of hanoi on ch32v003,\n");
-    printf("zx80 fonts and cvbs ntsc output.\n\n");
-    printf("github.com/lhartmann\n");
-    printf("          /ch32v003_cvbs\n");
+    hanoi_puts(ctx, "\n\n");
+    hanoi_puts(ctx, "towers of hanoi on ch32v003,\n");
+    hanoi_puts(ctx, "zx80 fonts and cvbs ntsc output.\n\n");
+    hanoi_puts(ctx, "github.com/lhartmann\n");
+    hanoi_puts(ctx, "          /ch32v003_cvbs\n");
 }
 
 bool hanoi_place_at(hanoi_context_t *ctx, unsigned pin, unsigned piece) {
@@ -304,7 +309,7 @@ void hanoi_main(cvbs_text_32x24_context_t *cvbs_text) {
         hanoi_place_at(&ctx, pin, piece);
     }
     hanoi_print(&ctx);
-    printf("Worst case scneario for dynamic width.\n");
+    hanoi_puts(&ctx, "Worst case scneario for dynamic width.\n");
     Delay_Ms(5000);
 
     // Test random states
@@ -313,7 +318,7 @@ void hanoi_main(cvbs_text_32x24_context_t *cvbs_text) {
         hanoi_print(&ctx);
         for (int i=0; i<32; i++)
             hanoi_putc('0'+i%10, 1);
-        printf("Random scnearios...\n");
+        hanoi_puts(&ctx, "Random scnearios...\n");
         Delay_Ms(1000);
     }
 }
@@ -0,0 +1,12 @@
+// Mock register file for the host build, see ch32v003fun.h
+#include "ch32v003fun.h"
+
+TIM_TypeDef host_TIM1;
+SPI_TypeDef host_SPI1;
+DMA_Channel_TypeDef host_DMA1_Channel3;
+DMA_Channel_TypeDef host_DMA1_Channel6;
+SysTick_Type host_SysTick;
+RCC_TypeDef host_RCC;
+GPIO_TypeDef host_GPIOC;
+GPIO_TypeDef host_GPIOD;
+volatile uint8_t host_NVIC_enabled[HOST_IRQn_COUNT];
@@ -0,0 +1,135 @@
+// Host-side stand-in for ch32v003fun.h
+//
+// Only the registers and constants touched by the cvbs core are modelled.
+// Every register is a plain RAM word, so the host simulator can inspect what
+// the ISR programmed and emulate TIM1/SPI1/DMA behaviour around it.
+//
+// Peripheral addresses are truncated to 32 bits by the code under test, just
+// like on the MCU, so anything handed to DMA must live in the low 4GB. Build
+// with -no-pie and keep contexts in static storage.
+#ifndef CH32V003FUN_HOST_H
+#define CH32V003FUN_HOST_H
+#include <stdint.h>
+
+// RISC-V interrupt attribute has no host equivalent, ISRs are plain calls here.
+#define interrupt
+
+typedef struct {
+	volatile uint32_t CTLR1, CTLR2, SMCFGR, DMAINTENR, INTFR, SWEVGR;
+	volatile uint32_t CHCTLR1, CHCTLR2, CCER, CNT, PSC, ATRLR, RPTCR;
+	volatile uint32_t CH1CVR, CH2CVR, CH3CVR, CH4CVR, BDTR, DMACFGR, DMAADR;
+} TIM_TypeDef;
+
+typedef struct {
+	volatile uint32_t CTLR1, CTLR2, STATR, DATAR, CRCR, RCRCR, TCRCR, HSCR;
+} SPI_TypeDef;
+
+typedef struct {
+	volatile uint32_t CFGR, CNTR, PADDR, MADDR;
+} DMA_Channel_TypeDef;
+
+typedef struct {
+	volatile uint32_t CTLR, SR, CNT, CMP;
+} SysTick_Type;
+
+typedef struct {
+	volatile uint32_t CTLR, CFGR0, INTR, APB2PRSTR, APB1PRSTR, AHBPCENR, APB2PCENR, APB1PCENR;
+} RCC_TypeDef;
+
+typedef struct {
+	volatile uint32_t CFGLR, INDR, OUTDR, BSHR, BCR, LCKR;
+} GPIO_TypeDef;
+
+typedef enum {
+	TIM1_UP_IRQn = 35,
+	HOST_IRQn_COUNT = 64,
+} IRQn_Type;
+
+// Mock register file, defined in ch32v003fun.c
+extern TIM_TypeDef host_TIM1;
+extern SPI_TypeDef host_SPI1;
+extern DMA_Channel_TypeDef host_DMA1_Channel3;
+extern DMA_Channel_TypeDef host_DMA1_Channel6;
+extern SysTick_Type host_SysTick;
+extern RCC_TypeDef host_RCC;
+extern GPIO_TypeDef host_GPIOC;
+extern GPIO_TypeDef host_GPIOD;
+extern volatile uint8_t host_NVIC_enabled[HOST_IRQn_COUNT];
+
+#define TIM1          (&host_TIM1)
+#define SPI1          (&host_SPI1)
+#define DMA1_Channel3 (&host_DMA1_Channel3)
+#define DMA1_Channel6 (&host_DMA1_Channel6)
+#define SysTick       (&host_SysTick)
+#define RCC           (&host_RCC)
+#define GPIOC         (&host_GPIOC)
+#define GPIOD         (&host_GPIOD)
+
+static inline void NVIC_EnableIRQ(IRQn_Type irq) { host_NVIC_enabled[irq] = 1; }
+static inline void NVIC_DisableIRQ(IRQn_Type irq) { host_NVIC_enabled[irq] = 0; }
+
+// WFI ends with the next interrupt, here the next update event, run by
+// host_wfi() in host_tv.c. Interrupts are plain calls, no masking needed.
+void host_wfi(void);
+static inline void __WFI(void) { host_wfi(); }
+static inline void __enable_irq(void) {}
+static inline void __disable_irq(void) {}
+
+// RCC
+#define RCC_AHBPeriph_DMA1      0x0001
+#define RCC_APB2Periph_GPIOC    0x0010
+#define RCC_APB2Periph_GPIOD    0x0020
+#define RCC_APB2Periph_TIM1     0x0800
+#define RCC_APB2Periph_SPI1     0x1000
+#define RCC_TIM1RST             0x0800
+#define RCC_SPI1RST             0x1000
+
+// GPIO
+#define GPIO_Speed_10MHz        0x1
+#define GPIO_CNF_OUT_PP_AF      0x8
+
+// TIM
+#define TIM_CEN                 0x0001
+#define TIM_URS                 0x0004
+#define TIM_ARPE                0x0080
+#define TIM_UIE                 0x0001
+#define TIM_CC3DE               0x0800
+#define TIM_UIF                 0x0001
+#define TIM_OC1PE               0x0008
+#define TIM_OC1M_0              0x0010
+#define TIM_OC3PE               0x0008
+#define TIM_OC3M_0              0x0010
+#define TIM_CC1E                0x0001
+#define TIM_CC1P                0x0002
+#define TIM_MOE                 0x8000
+
+// SPI
+#define SPI_CPHA_1Edge          0x0000
+#define SPI_CPOL_Low            0x0000
+#define SPI_Mode_Master         0x0104
+#define SPI_BaudRatePrescaler_4  0x0008
+#define SPI_BaudRatePrescaler_8  0x0010
+#define SPI_BaudRatePrescaler_16 0x0018
+#define SPI_CTLR1_BR            0x0038
+#define SPI_CTLR1_SPE           0x0040
+#define SPI_NSS_Soft            0x0200
+#define SPI_DataSize_8b         0x0000
+#define SPI_Direction_1Line_Tx  0xC000
+#define SPI_CTLR2_TXDMAEN       0x0002
+
+// DMA
+#define DMA_CFGR1_EN                0x0001
+#define DMA_DIR_PeripheralDST       0x0010
+#define DMA_Mode_Normal             0x0000
+#define DMA_Mode_Circular           0x0020
+#define DMA_PeripheralInc_Disable   0x0000
+#define DMA_MemoryInc_Enable        0x0080
+#define DMA_MemoryInc_Disable       0x0000
+#define DMA_PeripheralDataSize_Byte 0x0000
+#define DMA_PeripheralDataSize_Word 0x0200
+#define DMA_MemoryDataSize_Byte     0x0000
+#define DMA_MemoryDataSize_Word     0x0800
+#define DMA_Priority_VeryHigh       0x3000
+#define DMA_M2M_Disable             0x0000
+
+#endif // CH32V003FUN_HOST_H
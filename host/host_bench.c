@@ -0,0 +1,493 @@
+/*
+ * Host benchmark for on_scanline kernels.
+ *
+ * There is no cycle counter to read on the host, so the benchmark runs in a
+ * child process that the parent single-steps with ptrace. Every clock read in
+ * the child stops it, the parent writes the number of instructions stepped so
+ * far into it, then toggles between single-stepping and running freely. Clock
+ * reads must therefore come in start/stop pairs, as cvbs_bench.h does.
+ *
+ * Results are host instructions: good for comparing kernels and catching
+ * regressions, not RV32EC cycles. Run the benchmark on target for those.
+ *
+ * Text is also checked and timed with a bank of user glyphs mapped in.
+ *
+ * With sprites built in, the graphics kernels are also timed with the most
+ * sprites a row can show.
+ *
+ * The formatted output section checks ch32v003_cvbs_format.h against the host
+ * C library's snprintf, then times both per formatted number. The host libc is
+ * glibc, not newlib, so the baseline is only indicative.
+ *
+ * The drawing section checks every primitive in
+ * ch32v003_cvbs_graphics_128x96_draw.h against a pixel by pixel reference,
+ * with random clipped coordinates, then reports pixels drawn per 100
+ * instructions, next to a set_pixel() loop doing the same job.
+ *
+ * Usage: host_bench
+ */
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static volatile long host_bench_instret;
+
+static uint32_t host_bench_clock(void) {
+	raise(SIGSTOP);
+	return host_bench_instret;
+}
+
+#define cvbs_bench_clock() host_bench_clock()
+#include "cvbs_bench.h"
+#include "fonts/ascii.h"
+#include "fonts/ascii_inverted.h"
+#include "ch32v003_cvbs_text_32x24.h"
+#include "ch32v003_cvbs_graphics_128x96.h"
+#include "ch32v003_cvbs_format.h"
+#include "ch32v003_cvbs_graphics_128x96_draw.h"
+#include "ch32v003_cvbs_viewport.h"
+
+#define CVBS_STR_(x) #x
+#define CVBS_STR(x) CVBS_STR_(x)
+
+static cvbs_text_32x24_context_t cvbs_text;
+static cvbs_graphics_128x96_context_t cvbs_gfx;
+static cvbs_graphics_128x96_context_t ref_gfx;
+static cvbs_viewport_context_t cvbs_view;
+static cvbs_bench_result_t results[8];
+
+static uint32_t lfsr(void) {
+	static uint32_t k = 12345678;
+	k = k&1 ? (k>>1) ^ 0xA0000001UL : k>>1;
+	return k;
+}
+
+// Steps to the last blank line, where modes latch their frame, and runs
+// on_vblank there. Any sequence order works.
+static void last_blank_line(cvbs_context_t *cvbs) {
+	const cvbs_pulse_t *seq = cvbs->pulse_properties->pulse_sequence;
+	cvbs->pulse_index = 0;
+	cvbs->current_pulse = seq[0];
+	cvbs->pulse_counter = seq[0].duration;
+	cvbs->line = 0;
+	while (!cvbs_is_last_blank_line(cvbs))
+		cvbs_step(cvbs);
+	cvbs->on_vblank(cvbs);
+}
+
+// A bench that times nothing is worse than none.
+static void require(bool ok, const char *what) {
+	if (ok)
+		return;
+	fprintf(stdout, "%s\n", what);
+	fflush(stdout);
+	_exit(1);
+}
+
+static int stdout_write(const char *buf, int size) {
+	return fwrite(buf, 1, size, stdout);
+}
+
+static void bench(const char *mode, const char *vram, cvbs_context_t *cvbs, const cvbs_kernel_t *kernels) {
+	fprintf(stdout, "== %s, VRAM %s ==\n", mode, vram);
+	int n = cvbs_bench_kernels(cvbs, kernels, results, sizeof(results)/sizeof(*results));
+	cvbs_bench_print(results, n, 0, stdout_write);
+	fflush(stdout);
+}
+
+// Renders every line with user glyphs mapped, compares with a lookup per
+// character. Only the default kernel handles user glyphs.
+static void check_user_glyphs(const uint8_t *font, const cvbs_kernel_t *kernel) {
+	cvbs_context_t *cvbs = &cvbs_text.cvbs;
+	const cvbs_text_32x24_glyphs_t *glyphs = cvbs_text.user_glyphs;
+	cvbs_scanline_t scanline;
+	int errors = 0;
+
+	cvbs_text.active_font = font;
+	cvbs_text.first_row = 0;
+	for (int line=0; line<24*8; line++) {
+		cvbs->line = line;
+		kernel->on_scanline(cvbs, &scanline);
+		for (int i=0; i<32; i++) {
+			uint8_t c = cvbs_text.VRAM[line/8*32 + i];
+			uint8_t g = (c & 0x70) == cvbs_text.user_glyphs_code ?
+				glyphs->rows[line%8][c & 15] :
+				font[1 + ((line%8) << *font) + (c & 0x7F)];
+			if (c & 0x80)
+				g = ~g;
+			errors += scanline.data[i] != g;
+		}
+	}
+	cvbs_text.active_font = ascii_font;
+	fprintf(stdout, "== user glyphs, %s, font with %d glyphs, %d mismatches ==\n", kernel->name, 1 << *font, errors);
+}
+
+// Compares a formatter with snprintf on every value, returns mismatches.
+#define CHECK_FORMAT(call, fmt, v) do { \
+		char a[16], b[16]; \
+		int n = call; \
+		a[n] = 0; \
+		snprintf(b, sizeof(b), fmt, v); \
+		if (strcmp(a, b)) { \
+			fprintf(stdout, "mismatch: " fmt " gave '%s', expected '%s'\n", v, a, b); \
+			errors++; \
+		} \
+	} while (0)
+
+// Time of a statement over every value, per value.
+#define TIME_FORMAT(name, stmt) do { \
+		uint32_t t = cvbs_bench_clock(); \
+		for (int i=0; i<n_values; i++) \
+			stmt; \
+		t = cvbs_bench_clock() - t - overhead; \
+		fprintf(stdout, "%-28s %5u\n", name, t / n_values); \
+	} while (0)
+
+static void bench_format(void) {
+	static uint32_t values[256];
+	const int n_values = sizeof(values) / sizeof(*values);
+	int errors = 0;
+
+	// Every magnitude, plus the edge cases.
+	for (int i=0; i<n_values; i++)
+		values[i] = lfsr() >> (i & 31);
+	values[0] = 0;
+	values[1] = UINT32_MAX;
+	values[2] = 0x80000000;
+	values[3] = 4000000000;
+	values[4] = 999999999;
+
+	for (int i=0; i<n_values; i++) {
+		uint32_t v = values[i];
+		CHECK_FORMAT(cvbs_format_u32(a, v), "%u", v);
+		CHECK_FORMAT(cvbs_format_i32(a, v), "%d", (int32_t)v);
+		CHECK_FORMAT(cvbs_format_hex(a, v, 0, false), "%x", v);
+		CHECK_FORMAT(cvbs_format_hex(a, v, 8, true), "%08X", v);
+	}
+
+	cvbs_text_32x24_context_init(&cvbs_text, CVBS_STD_ZX81_NTSC);
+	char buf[64];
+	const char *line_fmt = "%d, AD=%ld, BD=%ld, T=%5d.\n";
+	for (int i=0; i<n_values; i++) {
+		uint32_t v = values[i];
+		cvbs_text.cursor_position = 0;
+		int n = cvbs_text_32x24_printf(&cvbs_text, line_fmt, i, (long)(int32_t)v, -(long)(v >> 20), (int)(v & 0xFFFF));
+		int m = snprintf(buf, sizeof(buf), line_fmt, i, (long)(int32_t)v, -(long)(v >> 20), (int)(v & 0xFFFF));
+		if (n != m || memcmp(cvbs_text.VRAM, buf, m-1)) {
+			fprintf(stdout, "mismatch: printf gave '%.*s', expected '%s'\n", n, cvbs_text.VRAM, buf);
+			errors++;
+		}
+	}
+
+	fprintf(stdout, "== formatted output, %d values, %d mismatches ==\n", n_values, errors);
+	fprintf(stdout, "per number                   instr\n");
+	uint32_t overhead = cvbs_bench_overhead();
+	TIME_FORMAT("cvbs_format_u32", cvbs_format_u32(buf, values[i]));
+	TIME_FORMAT("snprintf %u", snprintf(buf, sizeof(buf), "%u", values[i]));
+	TIME_FORMAT("cvbs_format_i32", cvbs_format_i32(buf, values[i]));
+	TIME_FORMAT("snprintf %d", snprintf(buf, sizeof(buf), "%d", (int32_t)values[i]));
+	TIME_FORMAT("cvbs_format_hex", cvbs_format_hex(buf, values[i], 0, false));
+	TIME_FORMAT("snprintf %x", snprintf(buf, sizeof(buf), "%x", values[i]));
+
+	fprintf(stdout, "per telemetry line to VRAM   instr\n");
+	TIME_FORMAT("cvbs_text_32x24_printf", (
+		cvbs_text.cursor_position = 0,
+		cvbs_text_32x24_printf(&cvbs_text, line_fmt, i, (long)values[i], (long)i, 3072)));
+	TIME_FORMAT("snprintf + write", (
+		cvbs_text.cursor_position = 0,
+		cvbs_text_32x24_write(&cvbs_text, buf, snprintf(buf, sizeof(buf), line_fmt, i, (long)values[i], (long)i, 3072))));
+	fflush(stdout);
+}
+
+// Reference drawing, one pixel at a time on ref_gfx.
+static void ref_pixel(int x, int y, bool bit, cvbs_graphics_128x96_op_t op) {
+	if (x < 0 || x >= 128 || y < 0 || y >= 96)
+		return;
+	bool on = cvbs_graphics_128x96_get_pixel(&ref_gfx, x, y);
+	switch (op) {
+		case CVBS_GRAPHICS_128X96_SET:   on |= bit; break;
+		case CVBS_GRAPHICS_128X96_CLEAR: on &= !bit; break;
+		case CVBS_GRAPHICS_128X96_XOR:   on ^= bit; break;
+		case CVBS_GRAPHICS_128X96_COPY:  on = bit; break;
+	}
+	cvbs_graphics_128x96_set_pixel(&ref_gfx, x, y, on);
+}
+
+static void ref_line(int x0, int y0, int x1, int y1, cvbs_graphics_128x96_op_t op) {
+	int dx = abs(x1 - x0), dy = -abs(y1 - y0);
+	int sx = x0 < x1 ? 1 : -1, sy = y0 < y1 ? 1 : -1;
+	for (int err = dx + dy;;) {
+		ref_pixel(x0, y0, 1, op);
+		if (x0 == x1 && y0 == y1)
+			break;
+		int e2 = 2*err;
+		if (e2 >= dy) { err += dy; x0 += sx; }
+		if (e2 <= dx) { err += dx; y0 += sy; }
+	}
+}
+
+static void ref_blit(int x, int y, const uint8_t *src, int w, int h, int stride, cvbs_graphics_128x96_op_t op) {
+	for (int j=0; j<h; j++)
+		for (int i=0; i<w; i++)
+			ref_pixel(x+i, y+j, src[j*stride + i/8] & 0x80 >> i%8, op);
+}
+
+static int rnd(int lo, int hi) {
+	return lo + lfsr() % (hi - lo + 1);
+}
+
+// Draws with both, returns 1 on any difference.
+static int check_draw(const char *name, int i) {
+	if (!memcmp(cvbs_gfx.back, ref_gfx.back, sizeof(cvbs_gfx.VRAM)))
+		return 0;
+	fprintf(stdout, "mismatch: %s, case %d\n", name, i);
+	memcpy(cvbs_gfx.back, ref_gfx.back, sizeof(cvbs_gfx.VRAM));
+	return 1;
+}
+
+#define TIME_DRAW(name, pixels, stmt) do { \
+		uint32_t t = cvbs_bench_clock(); \
+		stmt; \
+		t = cvbs_bench_clock() - t - overhead; \
+		fprintf(stdout, "%-28s %6u %8u %8.1f\n", name, pixels, t, (pixels) * 100.0 / t); \
+	} while (0)
+
+static void bench_draw(void) {
+	static const char text[] = "The quick brown fox jumps over\n the lazy dog \xC1\xC2\xC3";
+	static uint8_t sprite[24*3];
+	int errors = 0;
+
+	cvbs_graphics_128x96_context_init(&cvbs_gfx, CVBS_STD_ZX81_NTSC);
+	cvbs_graphics_128x96_context_init(&ref_gfx, CVBS_STD_ZX81_NTSC);
+	for (int i=0; i<sizeof(sprite); i++)
+		sprite[i] = lfsr();
+
+	for (int i=0; i<200; i++) {
+		cvbs_graphics_128x96_op_t op = i & 3;
+		int x0 = rnd(-20, 147), y0 = rnd(-20, 115), x1 = rnd(-20, 147), y1 = rnd(-20, 115);
+		if (i & 4) {
+			x0 = x0 & 127;
+			x1 = x1 & 127;
+			y0 = (y0 & 127) % 96;
+			y1 = (y1 & 127) % 96;
+		}
+
+		cvbs_graphics_128x96_pixel(&cvbs_gfx, x0, y0, op);
+		ref_pixel(x0, y0, 1, op);
+		errors += check_draw("pixel", i);
+
+		cvbs_graphics_128x96_hline(&cvbs_gfx, x0, x1, y0, op);
+		for (int x=x0 < x1 ? x0 : x1; x<=(x0 < x1 ? x1 : x0); x++)
+			ref_pixel(x, y0, 1, op);
+		errors += check_draw("hline", i);
+
+		cvbs_graphics_128x96_vline(&cvbs_gfx, x0, y0, y1, op);
+		for (int y=y0 < y1 ? y0 : y1; y<=(y0 < y1 ? y1 : y0); y++)
+			ref_pixel(x0, y, 1, op);
+		errors += check_draw("vline", i);
+
+		cvbs_graphics_128x96_line(&cvbs_gfx, x0, y0, x1, y1, op);
+		ref_line(x0, y0, x1, y1, op);
+		errors += check_draw("line", i);
+
+		int w = x1 - x0, h = y1 - y0;
+		cvbs_graphics_128x96_rect(&cvbs_gfx, x0, y0, w, h, op);
+		if (w > 0 && h > 0) {
+			for (int x=x0; x<x0+w; x++) {
+				ref_pixel(x, y0, 1, op);
+				if (h > 1) ref_pixel(x, y0+h-1, 1, op);
+			}
+			for (int y=y0+1; y<y0+h-1; y++) {
+				ref_pixel(x0, y, 1, op);
+				if (w > 1) ref_pixel(x0+w-1, y, 1, op);
+			}
+		}
+		errors += check_draw("rect", i);
+
+		cvbs_graphics_128x96_fill_rect(&cvbs_gfx, x0, y0, w, h, op);
+		for (int y=y0; y<y0+h; y++)
+			for (int x=x0; x<x0+w; x++)
+				ref_pixel(x, y, 1, op);
+		errors += check_draw("fill_rect", i);
+
+		w = rnd(1, 24);
+		h = rnd(1, 24);
+		cvbs_graphics_128x96_blit(&cvbs_gfx, x1, y1, sprite, w, h, 3, op);
+		ref_blit(x1, y1, sprite, w, h, 3, op);
+		errors += check_draw("blit", i);
+
+		const uint8_t *font = i & 8 ? ascii_inverted_font : ascii_font;
+		int end = cvbs_graphics_128x96_text(&cvbs_gfx, x0, y1, font, "Az\xC1", op);
+		for (int c=0; c<3; c++) {
+			uint8_t glyph[8], code = "Az\xC1"[c];
+			for (int r=0; r<8; r++)
+				glyph[r] = font == ascii_font
+					? font[1 + (r << 7) + (code & 0x7F)] ^ (code & 0x80 ? 0xFF : 0)
+					: font[1 + (r << 8) + code];
+			ref_blit(x0 + 8*c, y1, glyph, 8, 8, 1, op);
+		}
+		errors += check_draw("text", i) + (end != x0 + 24);
+	}
+
+	fprintf(stdout, "== drawing primitives, 200 random cases each, %d mismatches ==\n", errors);
+	fprintf(stdout, "primitive                    pixels    instr px/100instr\n");
+	uint32_t overhead = cvbs_bench_overhead();
+	const cvbs_graphics_128x96_op_t set = CVBS_GRAPHICS_128X96_SET;
+
+	TIME_DRAW("set_pixel loop, 100x80", 8000,
+		for (int y=0; y<80; y++) for (int x=0; x<100; x++) cvbs_graphics_128x96_set_pixel(&cvbs_gfx, x+3, y+5, 1));
+	TIME_DRAW("fill_rect 100x80", 8000, cvbs_graphics_128x96_fill_rect(&cvbs_gfx, 3, 5, 100, 80, set));
+	TIME_DRAW("hline 120 px x 96", 120*96,
+		for (int y=0; y<96; y++) cvbs_graphics_128x96_hline(&cvbs_gfx, 5, 124, y, set));
+	TIME_DRAW("vline 96 px x 128", 96*128,
+		for (int x=0; x<128; x++) cvbs_graphics_128x96_vline(&cvbs_gfx, x, 0, 95, set));
+	TIME_DRAW("line, 128 diagonals", 128*128,
+		for (int y=0; y<128; y++) cvbs_graphics_128x96_line(&cvbs_gfx, 0, y*95/127, 127, 95 - y*95/127, set));
+	TIME_DRAW("blit 24x24 x 16, aligned", 24*24*16,
+		for (int i=0; i<16; i++) cvbs_graphics_128x96_blit(&cvbs_gfx, 8*(i%4), 24*(i/4), sprite, 24, 24, 3, set));
+	TIME_DRAW("blit 24x24 x 16, unaligned", 24*24*16,
+		for (int i=0; i<16; i++) cvbs_graphics_128x96_blit(&cvbs_gfx, 8*(i%4)+3, 24*(i/4), sprite, 24, 24, 3, set));
+	TIME_DRAW("text 45 chars, aligned", 45*64,
+		cvbs_graphics_128x96_text(&cvbs_gfx, 0, 8, ascii_font, text, CVBS_GRAPHICS_128X96_COPY));
+	TIME_DRAW("text 45 chars, unaligned", 45*64,
+		cvbs_graphics_128x96_text(&cvbs_gfx, 5, 8, ascii_font, text, CVBS_GRAPHICS_128X96_COPY));
+	fflush(stdout);
+}
+
+static void run_benchmarks(void) {
+	cvbs_text_32x24_context_init(&cvbs_text, CVBS_STD_ZX81_NTSC);
+	cvbs_text.active_font = ascii_font;
+	cvbs_context_t *cvbs = &cvbs_text.cvbs;
+
+	memset(cvbs_text.VRAM, ' ', sizeof(cvbs_text.VRAM));
+	bench("text 32x24", "blank", cvbs, cvbs_text_32x24_kernels);
+
+	for (int i=0; i<sizeof(cvbs_text.VRAM); i++)
+		cvbs_text.VRAM[i] = ' ' + i % 95;
+	bench("text 32x24", "printable", cvbs, cvbs_text_32x24_kernels);
+
+	for (int i=0; i<sizeof(cvbs_text.VRAM); i++)
+		cvbs_text.VRAM[i] = (' ' + i % 95) | (i & 0x80);
+	bench("text 32x24", "mixed inverse", cvbs, cvbs_text_32x24_kernels);
+
+	cvbs_text.active_font = ascii_inverted_font;
+	bench("text 32x24, pre-inverted font", "mixed inverse", cvbs, cvbs_text_32x24_kernels);
+	cvbs_text.active_font = ascii_font;
+
+	for (int i=0; i<sizeof(cvbs_text.VRAM); i++)
+		cvbs_text.VRAM[i] = lfsr();
+	bench("text 32x24", "random", cvbs, cvbs_text_32x24_kernels);
+
+	static cvbs_text_32x24_glyphs_t glyphs;
+	for (int r=0; r<8; r++)
+		for (int g=0; g<16; g++)
+			glyphs.rows[r][g] = lfsr();
+	cvbs_text_32x24_set_user_glyphs(&cvbs_text, &glyphs, 0x40);
+	check_user_glyphs(ascii_font, &cvbs_text_32x24_kernels[0]);
+	check_user_glyphs(ascii_inverted_font, &cvbs_text_32x24_kernels[0]);
+	bench("text 32x24, 16 user glyphs", "random", cvbs, cvbs_text_32x24_kernels);
+	cvbs_text_32x24_set_user_glyphs(&cvbs_text, NULL, 0);
+
+	cvbs_graphics_128x96_context_init(&cvbs_gfx, CVBS_STD_ZX81_NTSC);
+	cvbs = &cvbs_gfx.cvbs;
+	bench("graphics 128x96", "blank", cvbs, cvbs_graphics_128x96_kernels);
+
+	for (int y=0; y<96; y++)
+		for (int i=0; i<128/8; i++)
+			cvbs_graphics_128x96_row(&cvbs_gfx, y)[i] = lfsr();
+	bench("graphics 128x96", "random", cvbs, cvbs_graphics_128x96_kernels);
+
+#if CVBS_GRAPHICS_128X96_SPRITES
+	// Worst case, SPRITES_PER_ROW wide sprites on every row, half of them masked.
+	static uint8_t sprite_bitmap[96*2];
+	for (int i=0; i<sizeof(sprite_bitmap); i++)
+		sprite_bitmap[i] = lfsr();
+	for (int i=0; i<CVBS_GRAPHICS_128X96_SPRITES_PER_ROW; i++) {
+		cvbs_graphics_128x96_sprite_t *s = &cvbs_gfx.sprites[i];
+		s->bitmap = sprite_bitmap;
+		s->mask = i&1 ? sprite_bitmap : NULL;
+		s->x = 3 + 29*i;
+		s->height = 96;
+		s->wide = 1;
+	}
+
+	last_blank_line(cvbs);
+	require(cvbs_gfx.sprite_count > 0, "sprites not sorted on the last blank line");
+	bench("graphics 128x96, " CVBS_STR(CVBS_GRAPHICS_128X96_SPRITES_PER_ROW) " sprites per row", "random", cvbs, cvbs_graphics_128x96_kernels);
+#endif
+
+	// The window across the bitmap's right edge, so rows are copied in two parts.
+	static uint8_t view_bitmap[192*256/8];
+	for (int i=0; i<sizeof(view_bitmap); i++)
+		view_bitmap[i] = lfsr();
+	cvbs_viewport_context_init(&cvbs_view, CVBS_STD_ZX81_NTSC, view_bitmap, 256, 192);
+	cvbs = &cvbs_view.cvbs;
+	cvbs_view.scroll_x = 3;
+	cvbs_view.scroll_y = 100;
+	last_blank_line(cvbs);
+	require(cvbs_view.column == 3/8 && cvbs_view.fine == 3 && cvbs_view.first_row == view_bitmap + 100*256/8,
+		"viewport scroll 3,100 not latched");
+	bench("viewport 256x192", "random, scrolled 3,100", cvbs, cvbs_viewport_kernels);
+	cvbs_view.scroll_x = 203;
+	last_blank_line(cvbs);
+	require(cvbs_view.column == 203/8 && cvbs_view.fine == 3, "viewport scroll 203,100 not latched");
+	bench("viewport 256x192", "random, scrolled 203,100", cvbs, cvbs_viewport_kernels);
+
+	bench_format();
+	bench_draw();
+}
+
+// Single-steps the child between clock read pairs, counting instructions.
+static int trace(pid_t child) {
+	long instret = 0;
+	bool stepping = false;
+	int status;
+
+	while (waitpid(child, &status, 0) == child) {
+		if (WIFEXITED(status))
+			return WEXITSTATUS(status);
+		if (WIFSIGNALED(status))
+			return 128 + WTERMSIG(status);
+
+		int sig = WSTOPSIG(status);
+		if (sig == SIGSTOP) {
+			ptrace(PTRACE_POKEDATA, child, &host_bench_instret, instret);
+			stepping = !stepping;
+			sig = 0;
+		} else if (sig == SIGTRAP && stepping) {
+			instret++;
+			sig = 0;
+		}
+
+		if (ptrace(stepping ? PTRACE_SINGLESTEP : PTRACE_CONT, child, 0, sig) < 0) {
+			perror("ptrace");
+			return 1;
+		}
+	}
+	return 1;
+}
+
+int main() {
+	fflush(stdout);
+	pid_t child = fork();
+	if (child < 0) {
+		perror("fork");
+		return 1;
+	}
+
+	if (!child) {
+		if (ptrace(PTRACE_TRACEME, 0, 0, 0) < 0) {
+			perror("PTRACE_TRACEME");
+			_exit(1);
+		}
+		run_benchmarks();
+		_exit(0);
+	}
+
+	return trace(child);
+}
@@ -0,0 +1,183 @@
+/*
+ * Host check of the fixed point Mandelbrot kernel.
+ *
+ * Renders both demo viewports with is_mandlebrot() and the double reference,
+ * and compares every pixel. Orbits that take most of the 100 iterations to
+ * escape, or that are only decided by the final |t| < 1 test, are chaotic:
+ * rounding alone flips them, and even different double implementations
+ * disagree. Those are reported as marginal. Any other mismatch fails.
+ *
+ * Then both viewports are drawn by the progressive renderer, through the
+ * text semigraphics and the graphics VRAM helpers, a few pixels per step. The
+ * result must match the kernel on every pixel, and the number of kernel
+ * evaluations is reported.
+ *
+ * mandelbrot_mul() is first checked against a 64 bit product, on edge and
+ * random values over its whole input range.
+ *
+ * The timing is host time, where doubles are done by an FPU. On the
+ * CH32V003 every double operation is a soft-float call.
+ *
+ * Usage: host_mandelbrot
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+// Each clock read is a tick, so every step does a few units of work.
+static uint32_t host_clock;
+#define mandelbrot_render_clock() (host_clock++)
+
+#include "mandlebrot.h"
+#include "gfx_demo_mandelbrot.h"
+
+static cvbs_text_32x24_context_t cvbs_text;
+static cvbs_graphics_128x96_context_t cvbs_gfx;
+
+typedef struct viewport_s {
+	const char *name;
+	int width, height;
+	int x0, y0;
+	int scale_log2;     // Pixels per unit
+} viewport_t;
+
+// Same as v81_mandelbrot() and v81_mandelbrot_128x96(), in that order.
+static const viewport_t viewports[] = {
+	{ "text 64x48",      64, 48, 48, 24, 5 },
+	{ "graphics 128x96", 128, 96, 96, 48, 6 },
+};
+
+// Iterations the reference needs to decide, 100 if it never escapes.
+static int escape_iteration(double re, double im) {
+	double tr = 0, ti = 0;
+	for (int i=0; i<100; i++) {
+		double kr = tr*tr - ti*ti + re;
+		double ki = tr*ti + tr*ti + im;
+		if (kr*kr + ki*ki > 4) return i;
+		tr = kr*kr - ki*ki + re;
+		ti = kr*ki + kr*ki + im;
+	}
+	return 100;
+}
+
+static double seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static volatile int sink;
+
+// Renders a viewport progressively and compares with mandlebrot_pixel().
+static int check_render(const viewport_t *vp, const mandelbrot_context_t *ctx, bool text, double t_double) {
+	mandelbrot_render_t r;
+	if (text) {
+		memset(cvbs_text.VRAM, 0, sizeof(cvbs_text.VRAM));
+		mandelbrot_render_init(&r, ctx, vp->width, vp->height, &cvbs_text, mandelbrot_text_get, mandelbrot_text_set);
+	} else {
+		cvbs_graphics_128x96_context_init(&cvbs_gfx, CVBS_STD_ZX81_NTSC);
+		cvbs_graphics_128x96_fill(&cvbs_gfx, 0x55);
+		mandelbrot_render_init(&r, ctx, vp->width, vp->height, &cvbs_gfx, mandelbrot_gfx_get, mandelbrot_gfx_set);
+	}
+
+	int steps = 1;
+	double t = seconds();
+	while (!mandelbrot_render_step(&r, 16))
+		steps++;
+	t = seconds() - t;
+
+	int wrong = 0;
+	for (int y=0; y<vp->height; y++)
+		for (int x=0; x<vp->width; x++)
+			if (r.get(r.target, x, y) != mandlebrot_pixel(x, y, ctx)) {
+				fprintf(stdout, "  %s render pixel %d,%d wrong\n", vp->name, x, y);
+				wrong++;
+			}
+
+	fprintf(stdout, "%s render: %lu evaluations in %d steps, %lu%% of pixels, %d wrong. Host time %.2fms, %.1fx faster than double per pixel\n",
+		vp->name, (unsigned long)r.evaluations, steps,
+		(unsigned long)r.evaluations * 100 / (vp->width * vp->height), wrong,
+		t * 1e3, t_double / t);
+	return wrong;
+}
+
+// Returns the number of products that differ from the 64 bit rounded one.
+static int check_mul(void) {
+	static const int32_t edges[] = { 0, 1, -1, 0xFFFF, 0x10000, -0x10000, -0x10001, (1<<27)-1, -(1<<27)+1 };
+	const int n_edges = sizeof(edges)/sizeof(*edges);
+	uint32_t k = 12345678;
+	int errors = 0;
+	for (int i=0; i<200000; i++) {
+		int32_t v[2];
+		for (int j=0; j<2; j++) {
+			k = k&1 ? (k>>1) ^ 0xA0000001UL : k>>1;
+			v[j] = i < n_edges*n_edges ? edges[j ? i%n_edges : i/n_edges] : (int32_t)(k % ((1<<28)-1)) - (1<<27) + 1;
+		}
+		for (int shift=MANDELBROT_Q-1; shift<=MANDELBROT_Q; shift++) {
+			int64_t expected = ((int64_t)v[0]*v[1] + (1LL << (shift-1))) >> shift;
+			if (expected > INT32_MAX || expected < INT32_MIN)
+				continue;
+			if (mandelbrot_mul(v[0], v[1], shift) != expected) {
+				if (errors++ < 8)
+					fprintf(stdout, "  mandelbrot_mul(%ld, %ld, %d) differs\n", (long)v[0], (long)v[1], shift);
+			}
+		}
+	}
+	fprintf(stdout, "mandelbrot_mul: %d mismatches\n", errors);
+	return errors;
+}
+
+int main() {
+	int failures = check_mul();
+
+	for (int v=0; v<sizeof(viewports)/sizeof(*viewports); v++) {
+		const viewport_t *vp = &viewports[v];
+		const double scale = 1.0 / (1 << vp->scale_log2);
+		const mandelbrot_context_t ctx = {
+			vp->x0, vp->y0,
+			MANDELBROT_FIXED(scale), MANDELBROT_FIXED(scale),
+			0
+		};
+
+		int inside = 0, marginal = 0, wrong = 0;
+		for (int y=0; y<vp->height; y++) {
+			for (int x=0; x<vp->width; x++) {
+				double re = (x - vp->x0) * scale;
+				double im = (y - vp->y0) * scale;
+				int ref = is_mandlebrot_double(re, im);
+				inside += ref;
+				if (mandlebrot_pixel(x, y, &ctx) == ref)
+					continue;
+
+				bool late = escape_iteration(re, im) >= 50;
+				fprintf(stdout, "  %s pixel %d,%d: double %d, fixed %d%s\n",
+					vp->name, x, y, ref, !ref, late ? ", marginal" : "");
+				if (late) marginal++;
+				else wrong++;
+			}
+		}
+
+		const int reps = 20;
+		double t = seconds();
+		for (int r=0; r<reps; r++)
+			for (int y=0; y<vp->height; y++)
+				for (int x=0; x<vp->width; x++)
+					sink = is_mandlebrot_double((x - vp->x0) * scale, (y - vp->y0) * scale);
+		double t_double = seconds() - t;
+
+		t = seconds();
+		for (int r=0; r<reps; r++)
+			for (int y=0; y<vp->height; y++)
+				for (int x=0; x<vp->width; x++)
+					sink = mandlebrot_pixel(x, y, &ctx);
+		double t_fixed = seconds() - t;
+
+		fprintf(stdout, "%s: %d pixels, %d inside, %d marginal, %d wrong. Host time double %.2fms, Q%d %.2fms, %.2fx\n",
+			vp->name, vp->width * vp->height, inside, marginal, wrong,
+			t_double * 1e3 / reps, MANDELBROT_Q, t_fixed * 1e3 / reps, t_double / t_fixed);
+		failures += wrong;
+		failures += check_render(vp, &ctx, v == 0, t_double / reps);
+	}
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,943 @@
+/*
+ * Host-side scanline simulator.
+ *
+ * Runs the real cvbs core and mode callbacks against the mock register file,
+ * drives TIM1_UP_IRQHandler through whole frames and dumps what the TV would
+ * see as PGM images. Optionally logs every line's timing and DMA bytes.
+ *
+ * Usage: host_sim <text|ring|gfx|flip|sprites|dl|split|viewport|switch|profile|late|tasks|raster> [frames] [prefix] [-v] [-i] [-s standard]
+ *
+ * The ring mode is text with render-ahead, built with
+ * CVBS_TEXT_32X24_RENDER_AHEAD, the producer runs once between update events,
+ * like an idle loop would. -i selects the pre-inverted font.
+ * -s selects the standard of the text and gfx modes, zx81ntsc by default.
+ *
+ * The text and gfx modes check every field: the mode's lines, centered in
+ * the standard's active lines with blank ones around them, must match what
+ * VRAM and the font give. Built with CVBS_TEXT_32X24_INTERLACED, as
+ * host_sim_interlaced, text rows alternate between the two fields.
+ *
+ * The flip mode is gfx with a box moved on the back page every frame, then
+ * flipped. It checks that every flip is done by the next frame, and that the
+ * back page matches the front one after it. Build with 2 pages to use it.
+ *
+ * The sprites mode is gfx with sprites moving over it, crossing each other
+ * and the screen edges. Every line the DMA sends, and the collisions of every
+ * frame, are checked against a pixel by pixel reference.
+ *
+ * The split mode is a display list of 96 lines of the gfx mode, then 4 rows
+ * of the text mode, then blank, 192 lines centered in the standard's. Every line is checked against what the mode's
+ * own kernel renders, and both modes must see one vblank per frame.
+ *
+ * The viewport mode scrolls a 128x96 window diagonally over a 256x192
+ * virtual bitmap, wrapping around, and checks every pixel sent, and where the
+ * line starts, against the bitmap.
+ *
+ * The switch mode starts in text mode and, halfway through frame 1, requests
+ * a live switch to gfx mode. Sync must not change at all across the switch,
+ * which must happen at the start of frame 2, with no frame mixing both modes.
+ *
+ * The profile mode runs gfx with every line charged a synthetic cost, through
+ * the SysTick and TIM1 counters the ISR reads, and one line late enough to
+ * overrun its DMA trigger. It checks the profiler's statistics every frame.
+ *
+ * The late mode runs gfx with the ISR started late on one active line a
+ * frame, just inside the margin of its DMA trigger, and one cycle less late on
+ * the next line. The late line must be dropped and counted, everything else,
+ * sync included, must match frame 0.
+ *
+ * The tasks mode runs gfx with two vblank tasks charged synthetic cycles, a
+ * short one done every frame and a long one carried over several frames. Every
+ * third blank line starts its ISR late, as if other ISR work ran first. It
+ * checks every blank line's budget is used, and never overrun, while work is
+ * left, and that tasks change nothing on screen.
+ *
+ * The raster mode runs gfx from the foreground only, through the WFI waits:
+ * it waits for active lines in and out of order, then for vsync, and checks
+ * each wait ends as its line starts, by the update events it took.
+ *
+ * Note: the text module provides putchar() and _write(). Host stdio may still
+ * inline its own putchar(), so VRAM is written through _write() and reports
+ * through fprintf().
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host_tv.h"
+#include "ch32v003fun.h"
+#include "fonts/ascii.h"
+#include "fonts/ascii_inverted.h"
+#include "ch32v003_cvbs_text_32x24.h"
+#include "ch32v003_cvbs_graphics_128x96.h"
+#include "ch32v003_cvbs_format.h"
+#include "ch32v003_cvbs_viewport.h"
+#include "cvbs_profile.h"
+
+// Static storage keeps addresses within 32 bits, see ch32v003fun.h.
+static cvbs_text_32x24_context_t cvbs_text;
+static cvbs_graphics_128x96_context_t cvbs_gfx;
+static host_line_t lines[1024];
+static host_line_t first_frame[1024];
+
+static cvbs_viewport_context_t cvbs_view;
+static uint8_t view_bitmap[192][256/8];
+
+static cvbs_context_t cvbs_dl;
+static cvbs_display_list_t display_list[4];
+static uint8_t dl_bitmap[64][17];
+
+// Stdio backend provided by the text module.
+int _write(int fd, const char *buf, int size);
+
+static void text_puts(const char *s) {
+	_write(1, s, strlen(s));
+}
+
+static const struct {
+	const char *name;
+	cvbs_standard_t standard;
+} standards[] = {
+	{ "pal",      CVBS_STD_PAL },
+	{ "zx81pal",  CVBS_STD_ZX81_PAL },
+	{ "zx81ntsc", CVBS_STD_ZX81_NTSC },
+	{ "ntsc",     CVBS_STD_NTSC },
+	{ "pal288p",  CVBS_STD_PAL_288P },
+};
+static cvbs_standard_t standard = CVBS_STD_ZX81_NTSC;
+
+static void text_setup(bool inverted_font) {
+	cvbs_text_32x24_context_init(&cvbs_text, standard);
+	cvbs_text.active_font = inverted_font ? ascii_inverted_font : ascii_font;
+	cvbs_init(&cvbs_text.cvbs);
+
+	text_puts("\fch32v003_cvbs host simulator\n\n");
+	for (char c=' '; c<0x7F; c++)
+		_write(1, &c, 1);
+
+	// Enough lines to scroll the banner off screen
+	char buf[32];
+	for (int i=0; i<20; i++)
+		_write(1, buf, snprintf(buf, sizeof(buf), "\nline %d", i));
+
+	for (int i=0; i<32; i++)
+		cvbs_text_32x24_row(&cvbs_text, 23)[i] = ('A' + i%26) | 0x80;
+}
+
+static void gfx_setup(void) {
+	cvbs_graphics_128x96_context_init(&cvbs_gfx, standard);
+	cvbs_init(&cvbs_gfx.cvbs);
+
+	for (int y=0; y<96; y++) {
+		for (int x=0; x<128; x++) {
+			bool on = x==0 || y==0 || x==127 || y==95 || x==y || x==127-y || ((x/8 + y/8) & 1 && y > 40 && y < 56);
+			cvbs_graphics_128x96_set_pixel(&cvbs_gfx, x, y, on);
+		}
+	}
+
+	// Show the drawing, with 2 pages it went to the back one.
+	host_line_t line;
+	cvbs_graphics_128x96_request_flip(&cvbs_gfx);
+	while (!cvbs_graphics_128x96_flip_done(&cvbs_gfx))
+		host_tv_update_event(&line);
+}
+
+// Bytes of screen line y, from VRAM through the font.
+static void text_reference(unsigned y, uint8_t *row) {
+	const uint8_t *font = cvbs_text.active_font;
+	const uint8_t *src = cvbs_text_32x24_row(&cvbs_text, y/8);
+	for (int x=0; x<32; x++) {
+		uint8_t c = src[x];
+		if (*font == 8)
+			row[x] = font[1 + ((y%8) << 8) + c];
+		else
+			row[x] = font[1 + ((y%8) << 7) + (c & 0x7F)] ^ (c & 0x80 ? 0xFF : 0);
+	}
+	row[32] = 0;
+}
+
+static void gfx_reference(unsigned y, uint8_t *row) {
+	memcpy(row, cvbs_gfx.front + y/2*CVBS_GRAPHICS_128X96_STRIDE, CVBS_GRAPHICS_128X96_STRIDE);
+}
+
+// Checks each block of armed lines, one per field: blank lines above and
+// below the mode's, which match the reference. Interlaced, field f shows
+// screen lines f, f+2...
+static bool screen_check(int frame, const host_line_t *lines, unsigned n, const cvbs_context_t *cvbs,
+		unsigned bytes, void (*reference)(unsigned y, uint8_t *row), bool interlaced) {
+	unsigned active = cvbs_active_lines(cvbs);
+	unsigned fields = 0;
+	for (unsigned i=0; i<n; i++) {
+		if (!lines[i].dma_armed || (i && lines[i-1].dma_armed))
+			continue;
+
+		unsigned end = i;
+		while (end < n && lines[end].dma_armed)
+			end++;
+		if (end-i != active) {
+			fprintf(stderr, "frame %d: field %u has %u active lines, expected %u.\n", frame, fields, end-i, active);
+			return false;
+		}
+		for (unsigned j=i; j<end; j++) {
+			int l = (int)(j-i) - cvbs->top;
+			if (l < 0 || l >= cvbs->lines) {
+				if (lines[j].data_length != 1 || lines[j].data[0]) {
+					fprintf(stderr, "frame %d: field %u line %u not blank.\n", frame, fields, j-i);
+					return false;
+				}
+				continue;
+			}
+			uint8_t row[HOST_LINE_MAX_DATA];
+			unsigned y = interlaced ? 2*l + fields : l;
+			reference(y, row);
+			if (lines[j].data_length != bytes || memcmp(lines[j].data, row, bytes)) {
+				fprintf(stderr, "frame %d: field %u screen line %u differs from the reference.\n", frame, fields, y);
+				return false;
+			}
+		}
+		fields++;
+	}
+	if (!fields || (interlaced && fields != 2)) {
+		fprintf(stderr, "frame %d: %u fields.\n", frame, fields);
+		return false;
+	}
+	fprintf(stderr, "frame %d: %u field%s of %u lines match, %u blank above.\n",
+		frame, fields, fields > 1 ? "s" : "", cvbs->lines, cvbs->top);
+	return true;
+}
+
+static void gfx_box(int x0, int y0, bool on) {
+	for (int y=y0; y<y0+16; y++)
+		for (int x=x0; x<x0+16; x++)
+			cvbs_graphics_128x96_set_pixel(&cvbs_gfx, x, y, on);
+}
+
+// Moves the box, returns false if the previous flip went wrong.
+static bool flip_frame(int frame) {
+	if (!cvbs_graphics_128x96_flip_done(&cvbs_gfx)) {
+		fprintf(stderr, "frame %d: flip still pending.\n", frame);
+		return false;
+	}
+	if (memcmp(cvbs_gfx.front, cvbs_gfx.back, sizeof(cvbs_gfx.VRAM))) {
+		fprintf(stderr, "frame %d: back page out of sync after flip.\n", frame);
+		return false;
+	}
+
+	if (frame)
+		gfx_box(8 + (frame-1)*8 % 96, 64, false);
+	gfx_box(8 + frame*8 % 96, 64, true);
+	cvbs_graphics_128x96_request_flip(&cvbs_gfx);
+	return true;
+}
+
+#if CVBS_GRAPHICS_128X96_SPRITES
+static const uint8_t ball[8] = { 0x3C, 0x7E, 0xFF, 0xFF, 0xFF, 0xFF, 0x7E, 0x3C };
+static const uint8_t ring[8] = { 0x3C, 0x42, 0x81, 0x81, 0x81, 0x81, 0x42, 0x3C };
+static const uint8_t ship[16] = {
+	0x01, 0x80, 0x03, 0xC0, 0x07, 0xE0, 0x0C, 0x30,
+	0x1F, 0xF8, 0x3F, 0xFC, 0x66, 0x66, 0xC0, 0x03,
+};
+// The ship's outline, so it cuts a hole in the background.
+static const uint8_t ship_mask[16] = {
+	0x03, 0xC0, 0x07, 0xE0, 0x0F, 0xF0, 0x1F, 0xF8,
+	0x3F, 0xFC, 0x7F, 0xFE, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+// Two sprites in each half of the screen, crossing each other and the edges,
+// and one across the middle. No row has more than SPRITES_PER_ROW of them.
+static void sprites_move(int frame) {
+	static const int16_t path[5][4] = {
+		// x, dx, y, dy
+		{ -16,  6, 12,  0 },
+		{ 128, -5, 10,  0 },
+		{  20,  3, 60,  1 },
+		{ 100, -4, 76,  0 },
+		{ -8,   7, 40,  0 },
+	};
+	for (int i=0; i<5; i++) {
+		cvbs_graphics_128x96_sprite_t *s = &cvbs_gfx.sprites[i];
+		s->bitmap = i&1 ? ship : i == 2 ? ring : ball;
+		s->mask = i == 3 ? ship_mask : NULL;
+		s->wide = i&1;
+		s->height = 8;
+		s->priority = 5-i;
+		s->x = path[i][0] + frame*path[i][1];
+		s->y = path[i][2] + frame*path[i][3];
+	}
+}
+
+// Row y as the sprites kernel should send it, adds up collisions.
+static void sprites_reference(unsigned y, uint8_t *row, uint8_t *hits) {
+	memcpy(row, cvbs_gfx.front + y*CVBS_GRAPHICS_128X96_STRIDE, 128/8);
+	uint8_t cover[128] = { 0 };
+	for (int p=0; p<=255; p++) {
+		for (int i=0; i<CVBS_GRAPHICS_128X96_SPRITES; i++) {
+			const cvbs_graphics_128x96_sprite_t *s = &cvbs_gfx.sprites[i];
+			unsigned dy = y - s->y;
+			if (s->priority != p || !s->height || dy >= s->height)
+				continue;
+			for (int k=0; k<(s->wide ? 16 : 8); k++) {
+				int x = s->x + k;
+				unsigned offset = dy*(s->wide ? 2 : 1) + k/8;
+				bool on = s->bitmap[offset] & 0x80 >> k%8;
+				bool shape = s->mask ? s->mask[offset] & 0x80 >> k%8 : on;
+				if (x < 0 || x >= 128 || !shape)
+					continue;
+				row[x/8] = on ? row[x/8] | 0x80 >> x%8 : row[x/8] & ~(0x80 >> x%8);
+				cover[x] |= 1 << i;
+			}
+		}
+	}
+	for (int x=0; x<128; x++)
+		for (int i=0; i<CVBS_GRAPHICS_128X96_SPRITES; i++)
+			if (cover[x] & 1 << i)
+				hits[i] |= cover[x] & ~(1 << i);
+}
+
+// Checks a frame of lines and collisions, returns false on any difference.
+static bool sprites_check(int frame, const host_line_t *lines, unsigned n) {
+	uint8_t hits[CVBS_GRAPHICS_128X96_SPRITES] = { 0 };
+	uint8_t row[128/8];
+	unsigned y = 0;
+	for (unsigned i=0; i<n && y<192; i++) {
+		if (!lines[i].dma_armed)
+			continue;
+		sprites_reference(y/2, row, hits);
+		if (memcmp(lines[i].data, row, sizeof(row)) || lines[i].data[128/8]) {
+			fprintf(stderr, "frame %d: line %u differs from the reference.\n", frame, y);
+			return false;
+		}
+		y++;
+	}
+
+	int n_hits = 0;
+	for (int i=0; i<CVBS_GRAPHICS_128X96_SPRITES; i++) {
+		if (cvbs_gfx.collisions[i] != hits[i]) {
+			fprintf(stderr, "frame %d: sprite %d collisions %02x, expected %02x.\n", frame, i, cvbs_gfx.collisions[i], hits[i]);
+			return false;
+		}
+		n_hits += !!hits[i];
+	}
+	if (cvbs_gfx.sprite_overflows) {
+		fprintf(stderr, "frame %d: %lu sprite overflows.\n", frame, (unsigned long)cvbs_gfx.sprite_overflows);
+		return false;
+	}
+	fprintf(stderr, "frame %d: sprites match, %d of them colliding.\n", frame, n_hits);
+	return true;
+}
+#endif
+
+// Display list: 64 rows doubled at 3MHz, a 32 line 6MHz band, then blank.
+static void dl_setup(void) {
+	cvbs_context_init(&cvbs_dl, standard);
+	cvbs_context_set_lines(&cvbs_dl, 192);
+
+	for (int y=0; y<64; y++)
+		for (int x=0; x<16; x++)
+			dl_bitmap[y][x] = x == y/4 ? 0xFF : (y&1 ? 0x81 : 0x00);
+
+	cvbs_scanline_t scanline = {
+		.horizontal_start = cvbs_horizontal_start(&cvbs_dl),
+		.data_length = 17,
+		.data = dl_bitmap[0],
+		.flags.pixel_clock_3M = 1,
+	};
+	cvbs_display_list_entry(&cvbs_dl, &display_list[0], &scanline, 128, 2, 17);
+
+	scanline.flags.pixel_clock_3M = 0;
+	scanline.data = dl_bitmap[8];
+	cvbs_display_list_entry(&cvbs_dl, &display_list[1], &scanline, 32, 32, 0);
+
+	cvbs_dl.display_list = display_list;
+	cvbs_init(&cvbs_dl);
+}
+
+// 96 lines of graphics at 3MHz over a 4 row text status bar at 6MHz.
+static void split_setup(void) {
+	text_setup(false);
+	text_puts("\f");
+	cvbs_text_32x24_printf(&cvbs_text, "T=%5d  RPM=%4u\nStatus bar at 6MHz", 1234, 5678);
+	gfx_setup();
+
+	cvbs_context_init(&cvbs_dl, standard);
+	cvbs_context_set_lines(&cvbs_dl, 192);
+	cvbs_display_list_context_entry(&display_list[0], &cvbs_gfx.cvbs, 96, 0);
+	cvbs_display_list_context_entry(&display_list[1], &cvbs_text.cvbs, 4*8, 0);
+	memset(&display_list[2], 0, sizeof(display_list[2]));
+	cvbs_dl.display_list = display_list;
+	cvbs_dl.on_vblank = cvbs_display_list_vblank;
+	cvbs_init(&cvbs_dl);
+}
+
+// Compares each band with its mode's kernel, returns false on any difference.
+static bool split_check(int frame, const host_line_t *lines, unsigned n, uint32_t frames_gfx, uint32_t frames_text) {
+	if (cvbs_gfx.frame_counter != frames_gfx+1 || cvbs_text.frame_counter != frames_text+1) {
+		fprintf(stderr, "frame %d: modes saw %lu and %lu vblanks.\n", frame,
+			(unsigned long)(cvbs_gfx.frame_counter - frames_gfx), (unsigned long)(cvbs_text.frame_counter - frames_text));
+		return false;
+	}
+
+	// Lines above the list are blank, and must not advance its cursor.
+	unsigned line = 0, top = cvbs_dl.top;
+	for (unsigned i=0; i<n; i++) {
+		if (!lines[i].dma_armed)
+			continue;
+		if (top) {
+			top--;
+			if (lines[i].data_length != 1) {
+				fprintf(stderr, "frame %d: line %u above the list not blank.\n", frame, i);
+				return false;
+			}
+			continue;
+		}
+
+		cvbs_context_t *mode = line < 96 ? &cvbs_gfx.cvbs : line < 128 ? &cvbs_text.cvbs : 0;
+		cvbs_scanline_t expected = { .data_length = 1 };
+		if (mode) {
+			mode->line = line < 96 ? line : line - 96;
+			mode->on_scanline(mode, &expected);
+		}
+		if (lines[i].data_length != expected.data_length ||
+			(mode && memcmp(lines[i].data, expected.data, expected.data_length)) ||
+			(mode && lines[i].spi_prescaler != (expected.flags.pixel_clock_3M ? 16 : 8))) {
+			fprintf(stderr, "frame %d: line %u differs from its mode.\n", frame, line);
+			return false;
+		}
+		line++;
+	}
+	return true;
+}
+
+// Grid, diagonals and a checkered band, so any offset shows.
+static bool view_pixel(unsigned x, unsigned y) {
+	return x%32 == 0 || y%24 == 0 || (x+y)%64 == 0 || ((x/4 ^ y/4) & 1 && y/24 == x/64);
+}
+
+static void viewport_setup(void) {
+	for (int y=0; y<192; y++)
+		for (int x=0; x<256; x++)
+			if (view_pixel(x, y))
+				view_bitmap[y][x/8] |= 0x80 >> x%8;
+	cvbs_viewport_context_init(&cvbs_view, standard, view_bitmap[0], 256, 192);
+	cvbs_init(&cvbs_view.cvbs);
+}
+
+// Diagonally, across both wrap-arounds within a few frames.
+static void viewport_scroll(int frame) {
+	cvbs_view.scroll_x = 250 + frame*3;
+	cvbs_view.scroll_y = 180 + frame;
+}
+
+// Checks every pixel sent, returns false on any difference.
+static bool viewport_check(int frame, const host_line_t *lines, unsigned n) {
+	unsigned x0 = cvbs_view.scroll_x % 256;
+	unsigned y0 = cvbs_view.scroll_y % 192;
+	unsigned start = cvbs_horizontal_start(&cvbs_view.cvbs) + cvbs_view.cvbs.pulse_properties->sync_normal - x0%8 * 16;
+
+	unsigned line = 0, top = cvbs_view.cvbs.top;
+	for (unsigned i=0; i<n; i++) {
+		if (!lines[i].dma_armed)
+			continue;
+
+		// Blank lines center the window.
+		if (top || line == 192) {
+			top -= !!top;
+			if (lines[i].data_length != 1) {
+				fprintf(stderr, "frame %d: line %u around the window not blank.\n", frame, i);
+				return false;
+			}
+			continue;
+		}
+
+		bool ok = lines[i].dma_start == start && lines[i].data_length == 18;
+		for (int j=0; j<18*8 && ok; j++) {
+			int p = j - x0%8;
+			bool expected = p >= 0 && p < 128 && view_pixel((x0 + p) % 256, (y0 + line/2) % 192);
+			ok = !(lines[i].data[j/8] & 0x80 >> j%8) == !expected;
+		}
+		if (!ok) {
+			fprintf(stderr, "frame %d: line %u differs from the bitmap.\n", frame, line);
+			return false;
+		}
+		line++;
+	}
+	return true;
+}
+
+// Compares a frame's sync with the first one, and which mode sent its pixels.
+static bool switch_check(int frame, const host_line_t *lines, const host_line_t *first, unsigned n) {
+	unsigned expected = frame < 2 ? 33 : 17;
+	for (unsigned i=0; i<n; i++) {
+		const host_line_t *l = &lines[i];
+		if (l->period != first[i].period || l->sync != first[i].sync || l->pulse_index != first[i].pulse_index || l->dma_armed != first[i].dma_armed) {
+			fprintf(stderr, "frame %d: sync differs from frame 0 at line %u.\n", frame, i);
+			return false;
+		}
+		if (l->dma_armed && l->data_length != expected) {
+			fprintf(stderr, "frame %d: line %u sent %u bytes, expected %u.\n", frame, i, l->data_length, expected);
+			return false;
+		}
+	}
+	if (frame == 2 && (!cvbs_switch_done() || cvbs_get_active_context() != &cvbs_gfx.cvbs)) {
+		fprintf(stderr, "frame %d: switch to gfx mode not done.\n", frame);
+		return false;
+	}
+	return true;
+}
+
+// Frame 0 line at which frame `frame` starts its ISR late, the first active
+// line plus 20 per frame.
+static unsigned late_line(int frame, const host_line_t *first) {
+	unsigned i = 0;
+	while (!first[i].dma_armed)
+		i++;
+	return i + 20*frame;
+}
+
+// Interrupt latency for line i, dropped at CVBS_LATE_MARGIN cycles from the
+// trigger, one cycle earlier is still in time.
+static unsigned late_latency(int frame, unsigned i, const host_line_t *first) {
+	if (!frame)
+		return 0;
+	unsigned late = late_line(frame, first);
+	if (i == late)
+		return first[i].dma_start - CVBS_LATE_MARGIN;
+	if (i == late+1)
+		return first[i].dma_start - CVBS_LATE_MARGIN - 1;
+	return 0;
+}
+
+// Compares a frame with the first one, only the late line may differ.
+static bool late_check(int frame, const host_line_t *lines, const host_line_t *first, unsigned n, uint32_t dropped) {
+	unsigned late = late_line(frame, first);
+	for (unsigned i=0; i<n; i++) {
+		const host_line_t *l = &lines[i];
+		if (l->period != first[i].period || l->sync != first[i].sync || l->pulse_index != first[i].pulse_index) {
+			fprintf(stderr, "frame %d: sync differs from frame 0 at line %u.\n", frame, i);
+			return false;
+		}
+		if (i == late) {
+			if (l->dma_armed) {
+				fprintf(stderr, "frame %d: late line %u still armed.\n", frame, i);
+				return false;
+			}
+		} else if (l->dma_armed != first[i].dma_armed || (l->dma_armed && (l->dma_start != first[i].dma_start ||
+				l->data_length != first[i].data_length || memcmp(l->data, first[i].data, l->data_length)))) {
+			fprintf(stderr, "frame %d: line %u differs from frame 0.\n", frame, i);
+			return false;
+		}
+	}
+	if (dropped != 1) {
+		fprintf(stderr, "frame %d: %lu lines counted as dropped, expected 1.\n", frame, (unsigned long)dropped);
+		return false;
+	}
+	return true;
+}
+
+// Checks the raster position, and the update events a wait took. Active lines
+// are consecutive and frames n_lines long, so both are known in advance.
+static bool raster_check(int frame, const char *what, int line, uint32_t frames, unsigned long events, unsigned long expected) {
+	if (cvbs_raster_line() != line || cvbs_frame_count() != frames || events != expected) {
+		fprintf(stderr, "frame %d: %s at line %d of frame %lu after %lu events, expected line %d of frame %lu after %lu.\n",
+			frame, what, cvbs_raster_line(), (unsigned long)cvbs_frame_count(), events, line, (unsigned long)frames, expected);
+		return false;
+	}
+	return true;
+}
+
+static bool raster_run(int frames, unsigned n_lines) {
+	static const int targets[] = { 0, 50, 10, 191, 191, 5 };
+
+	// From a known line, the last active one.
+	cvbs_wait_for_line(191);
+	int line = 191;
+	for (int frame=0; frame<frames; frame++) {
+		for (unsigned i=0; i<sizeof(targets)/sizeof(*targets); i++) {
+			int target = targets[i];
+			uint32_t frames_before = cvbs_frame_count();
+			unsigned long events = host_tv_events;
+			cvbs_wait_for_line(target);
+			unsigned long expected = target > line ? target - line : n_lines - (line - target);
+			if (!raster_check(frame, "line wait", target, frames_before + (target <= line), host_tv_events - events, expected))
+				return false;
+			line = target;
+		}
+
+		uint32_t frames_before = cvbs_frame_count();
+		unsigned long events = host_tv_events;
+		cvbs_wait_for_vsync();
+		if (!raster_check(frame, "vsync", -1, frames_before+1, host_tv_events - events, 192 - line))
+			return false;
+
+		// The mode counts its frames one line earlier, as it prepares the first
+		// blank line, so this ends on the last active line.
+		frames_before = cvbs_frame_count();
+		events = host_tv_events;
+		cvbs_graphics_128x96_wait_for_vsync(&cvbs_gfx);
+		if (!raster_check(frame, "gfx vsync", 191, frames_before, host_tv_events - events, n_lines-1))
+			return false;
+		line = 191;
+		fprintf(stderr, "frame %d: raster waits match.\n", frame);
+	}
+	return true;
+}
+
+#if CVBS_TASKS
+// Steps and their cost in cycles, per frame of work.
+#define TASK_INPUT_STEPS 20
+#define TASK_INPUT_COST 100
+#define TASK_REDRAW_STEPS 1000
+#define TASK_REDRAW_COST 200
+#define TASK_LATENCY 1400
+
+typedef struct task_work_s {
+	unsigned steps, cost;
+	unsigned progress;  // Steps done in the current frame of work
+	unsigned total;     // Steps done overall
+} task_work_t;
+
+static task_work_t task_input_work = { TASK_INPUT_STEPS, TASK_INPUT_COST };
+static task_work_t task_redraw_work = { TASK_REDRAW_STEPS, TASK_REDRAW_COST };
+static cvbs_task_t task_input, task_redraw;
+static unsigned task_cycles; // TIM1->CNT after tasks in the current ISR
+
+// Charges the step's cost through the counters the scheduler and TV read.
+static bool task_step(void *arg) {
+	task_work_t *w = arg;
+	SysTick->CNT += w->cost;
+	TIM1->CNT += w->cost;
+	task_cycles = TIM1->CNT;
+	w->total++;
+	if (++w->progress < w->steps)
+		return true;
+	w->progress = 0;
+	return false;
+}
+
+static void tasks_setup(void) {
+	gfx_setup();
+	task_input = (cvbs_task_t){ .step = task_step, .arg = &task_input_work };
+	task_redraw = (cvbs_task_t){ .step = task_step, .arg = &task_redraw_work };
+	cvbs_task_add(&task_input);
+	cvbs_task_add(&task_redraw);
+}
+
+// Checks the cycles tasks used on a blank line that started with `period`.
+// The budget, or what is left of the line after the ISR's latency, whichever
+// is less, must be used while there is work, and never overrun by more than
+// a step.
+static bool tasks_check_line(int frame, unsigned i, unsigned period, unsigned latency) {
+	unsigned used = task_cycles - latency;
+	unsigned limit = period - CVBS_TASK_MARGIN - latency;
+	if (limit > cvbs_task_budget)
+		limit = cvbs_task_budget;
+	if (used >= limit + TASK_REDRAW_COST) {
+		fprintf(stderr, "frame %d: tasks used %u cycles on line %u, limit %u.\n", frame, used, i, limit);
+		return false;
+	}
+	if (task_redraw.pending && used < limit) {
+		fprintf(stderr, "frame %d: tasks used %u cycles on line %u with work left, limit %u.\n", frame, used, i, limit);
+		return false;
+	}
+	return true;
+}
+
+// Whole frame: no line disturbed, the short task done every frame, and the
+// long one's steps all accounted for.
+static bool tasks_check(int frame, const host_line_t *lines, const host_line_t *first, unsigned n, uint32_t dropped) {
+	for (unsigned i=0; i<n; i++) {
+		const host_line_t *l = &lines[i];
+		if (l->period != first[i].period || l->sync != first[i].sync || l->dma_armed != first[i].dma_armed ||
+				(l->dma_armed && memcmp(l->data, first[i].data, l->data_length))) {
+			fprintf(stderr, "frame %d: line %u differs from frame 0.\n", frame, i);
+			return false;
+		}
+	}
+	if (dropped) {
+		fprintf(stderr, "frame %d: %lu lines dropped.\n", frame, (unsigned long)dropped);
+		return false;
+	}
+	if (task_input.done != frame+1 || task_input.late) {
+		fprintf(stderr, "frame %d: input task done %lu times, late %lu.\n", frame,
+			(unsigned long)task_input.done, (unsigned long)task_input.late);
+		return false;
+	}
+	if (task_redraw_work.total != task_redraw.done*TASK_REDRAW_STEPS + task_redraw_work.progress) {
+		fprintf(stderr, "frame %d: redraw task steps lost.\n", frame);
+		return false;
+	}
+	fprintf(stderr, "frame %d: redraw task done %lu times, late %lu, %u steps.\n", frame,
+		(unsigned long)task_redraw.done, (unsigned long)task_redraw.late, task_redraw_work.total);
+	return true;
+}
+#endif
+
+#if CVBS_PROFILE
+#define PROFILE_SLOW_LINE 100
+
+static void (*profile_kernel)(cvbs_context_t *ctx, cvbs_scanline_t *scanline);
+
+// 300 cycles plus the line number, or 3000 on the slow line.
+static unsigned profile_cost(int line) {
+	return line == PROFILE_SLOW_LINE ? 3000 : 300 + line;
+}
+
+static void profile_on_scanline(cvbs_context_t *cvbs, cvbs_scanline_t *scanline) {
+	profile_kernel(cvbs, scanline);
+	SysTick->CNT += profile_cost(cvbs->line);
+	TIM1->CNT += profile_cost(cvbs->line);
+}
+
+static int profile_write(const char *buf, int size) {
+	return fwrite(buf, 1, size, stderr);
+}
+
+// Every statistic after `frames` frames, returns false on any difference.
+static bool profile_check(int frames) {
+	cvbs_profile_t p;
+	cvbs_profile_snapshot(&p);
+
+	uint64_t total = 0;
+	for (int line=0; line<192; line++)
+		total += profile_cost(line);
+
+	const cvbs_profile_class_t *a = &p.active;
+	const cvbs_profile_class_t *b = &p.blank;
+	bool ok =
+		a->count == 192*frames && a->total == total*frames &&
+		a->min == profile_cost(0) && a->max == profile_cost(PROFILE_SLOW_LINE) && a->worst_line == PROFILE_SLOW_LINE &&
+		a->histogram[1] == 191*frames && a->histogram[CVBS_PROFILE_BINS-1] == frames &&
+		b->count == 70*frames && b->max == 0 && b->histogram[0] == 70*frames &&
+		p.overruns == frames && p.overrun_line == PROFILE_SLOW_LINE;
+	if (!ok) {
+		fprintf(stderr, "frame %d: profile differs from the synthetic costs.\n", frames-1);
+		cvbs_profile_print(&p, profile_write);
+	}
+	return ok;
+}
+#endif
+
+static void log_line(unsigned n, const host_line_t *l) {
+	fprintf(stdout, "%4u p%-2u %c%c%c%c T=%-4u S=%-4u",
+		n, l->pulse_index,
+		l->pulse.half_period ? 'H' : '-',
+		l->pulse.short_sync  ? 'S' : '-',
+		l->pulse.long_sync   ? 'L' : '-',
+		l->pulse.active      ? 'A' : '-',
+		l->period, l->sync);
+	if (l->dma_armed) {
+		fprintf(stdout, " D@%-4u /%-2u %2u:", l->dma_start, l->spi_prescaler, l->data_length);
+		for (unsigned i=0; i<l->data_length && i<HOST_LINE_MAX_DATA; i++)
+			fprintf(stdout, " %02x", l->data[i]);
+	}
+	fputs("\n", stdout);
+}
+
+int main(int argc, char **argv) {
+	bool verbose = false;
+	bool inverted_font = false;
+	const char *args[3] = { "text", "1", 0 };
+	for (int i=1, n=0; i<argc; i++) {
+		if (!strcmp(argv[i], "-v"))
+			verbose = true;
+		else if (!strcmp(argv[i], "-i"))
+			inverted_font = true;
+		else if (!strcmp(argv[i], "-s") && i+1 < argc) {
+			unsigned k = 0;
+			while (k < sizeof(standards)/sizeof(*standards) && strcmp(argv[i+1], standards[k].name))
+				k++;
+			if (k == sizeof(standards)/sizeof(*standards)) {
+				fprintf(stderr, "Unknown standard %s.\n", argv[i+1]);
+				return 1;
+			}
+			standard = standards[k].standard;
+			i++;
+		}
+		else if (n < 3)
+			args[n++] = argv[i];
+	}
+	const char *mode = args[0];
+	int frames = atoi(args[1]);
+	const char *prefix = args[2] ? args[2] : mode;
+
+	bool ring = !strcmp(mode, "ring");
+	bool flip = !strcmp(mode, "flip");
+	bool sprites = !strcmp(mode, "sprites");
+	bool split = !strcmp(mode, "split");
+	bool viewport = !strcmp(mode, "viewport");
+	bool switching = !strcmp(mode, "switch");
+	bool profile = !strcmp(mode, "profile");
+	bool late = !strcmp(mode, "late");
+	bool tasks = !strcmp(mode, "tasks");
+	bool raster = !strcmp(mode, "raster");
+	bool text = !strcmp(mode, "text");
+	bool gfx = !strcmp(mode, "gfx");
+	if (text) {
+		text_setup(inverted_font);
+	} else if (ring) {
+#if CVBS_TEXT_32X24_RENDER_AHEAD
+		text_setup(inverted_font);
+		cvbs_text_32x24_enable_render_ahead(&cvbs_text);
+#else
+		fprintf(stderr, "Ring mode needs CVBS_TEXT_32X24_RENDER_AHEAD=1.\n");
+		return 1;
+#endif
+	} else if (gfx || flip || late || raster) {
+		gfx_setup();
+		if (flip && cvbs_gfx.front == cvbs_gfx.back) {
+			fprintf(stderr, "Flip mode needs CVBS_GRAPHICS_128X96_PAGES=2.\n");
+			return 1;
+		}
+	} else if (sprites) {
+#if CVBS_GRAPHICS_128X96_SPRITES
+		gfx_setup();
+		cvbs_gfx.cvbs.on_scanline = cvbs_graphics_128x96_kernels[0].on_scanline;
+#else
+		fprintf(stderr, "Sprites mode needs CVBS_GRAPHICS_128X96_SPRITES.\n");
+		return 1;
+#endif
+	} else if (!strcmp(mode, "dl")) {
+		dl_setup();
+	} else if (split) {
+		split_setup();
+	} else if (viewport) {
+		viewport_setup();
+	} else if (profile) {
+#if CVBS_PROFILE
+		gfx_setup();
+		profile_kernel = cvbs_gfx.cvbs.on_scanline;
+		cvbs_gfx.cvbs.on_scanline = profile_on_scanline;
+#else
+		fprintf(stderr, "Profile mode needs CVBS_PROFILE=1.\n");
+		return 1;
+#endif
+	} else if (tasks) {
+#if CVBS_TASKS
+		tasks_setup();
+#else
+		fprintf(stderr, "Tasks mode needs CVBS_TASKS.\n");
+		return 1;
+#endif
+	} else if (switching) {
+		// Both set up front, then text mode is shown.
+		gfx_setup();
+		text_setup(false);
+	} else {
+		fprintf(stderr, "Usage: %s <text|ring|gfx|flip|sprites|dl|split|viewport|switch|profile|late|tasks|raster> [frames] [prefix] [-v] [-i] [-s standard]\n", argv[0]);
+		return 1;
+	}
+
+	if ((uintptr_t)&lines >> 32) {
+		fprintf(stderr, "Static data above 4GB, build with -no-pie.\n");
+		return 1;
+	}
+
+	cvbs_context_t *cvbs = cvbs_get_active_context();
+	unsigned n_lines = host_tv_frame_lines(cvbs);
+	if (n_lines > sizeof(lines)/sizeof(*lines) || !host_tv_sync_to_frame()) {
+		fprintf(stderr, "Pulse sequence does not fit the simulator.\n");
+		return 1;
+	}
+
+	if (raster) {
+		bool ok = raster_run(frames, n_lines);
+		cvbs_finish(cvbs);
+		return ok ? 0 : 1;
+	}
+
+#if CVBS_TEXT_32X24_RENDER_AHEAD
+	uint32_t underruns = cvbs_text.ring_underruns;
+#endif
+	for (int frame=0; frame<frames; frame++) {
+		if (flip && !flip_frame(frame))
+			return 1;
+#if CVBS_GRAPHICS_128X96_SPRITES
+		if (sprites)
+			sprites_move(frame);
+#endif
+		if (viewport)
+			viewport_scroll(frame);
+
+#if CVBS_PROFILE
+		if (profile && !frame)
+			cvbs_profile_reset();
+#endif
+		uint32_t frames_gfx = cvbs_gfx.frame_counter;
+		uint32_t frames_text = cvbs_text.frame_counter;
+		unsigned active = 0;
+		uint32_t dropped = cvbs->dropped_lines;
+		for (unsigned i=0; i<n_lines; i++) {
+			if (late)
+				host_tv_latency = late_latency(frame, i, first_frame);
+#if CVBS_TASKS
+			if (tasks)
+				host_tv_latency = !cvbs_is_active_line(cvbs) && i%3 == 0 ? TASK_LATENCY : 0;
+			task_cycles = host_tv_latency;
+#endif
+			host_tv_update_event(&lines[i]);
+#if CVBS_TASKS
+			if (tasks && !cvbs_is_active_line(cvbs) && !tasks_check_line(frame, i, lines[i].period, host_tv_latency))
+				return 1;
+#endif
+			if (switching && frame == 1 && i == n_lines/2)
+				cvbs_request_switch(&cvbs_gfx.cvbs);
+#if CVBS_TEXT_32X24_RENDER_AHEAD
+			if (ring)
+				cvbs_text_32x24_render_ahead(&cvbs_text);
+#endif
+			active += lines[i].dma_armed;
+			if (verbose)
+				log_line(i, &lines[i]);
+		}
+
+		char path[256];
+		snprintf(path, sizeof(path), "%s_%03d.pgm", prefix, frame);
+		if (host_tv_write_pgm(path, lines, n_lines)) {
+			perror(path);
+			return 1;
+		}
+		fprintf(stderr, "%s: %u lines, %u with pixel data.\n", path, n_lines, active);
+		if (text && !screen_check(frame, lines, n_lines, cvbs, 33, text_reference, CVBS_TEXT_32X24_INTERLACED))
+			return 1;
+		if (gfx && !screen_check(frame, lines, n_lines, cvbs, CVBS_GRAPHICS_128X96_STRIDE, gfx_reference, false))
+			return 1;
+		if (split && !split_check(frame, lines, n_lines, frames_gfx, frames_text))
+			return 1;
+		if (viewport && !viewport_check(frame, lines, n_lines))
+			return 1;
+#if CVBS_PROFILE
+		if (profile && !profile_check(frame+1))
+			return 1;
+#endif
+#if CVBS_TASKS
+		if (tasks && frame && !tasks_check(frame, lines, first_frame, n_lines, cvbs->dropped_lines - dropped))
+			return 1;
+#endif
+		if (switching || late || tasks) {
+			if (!frame)
+				memcpy(first_frame, lines, sizeof(lines));
+			else if (switching && !switch_check(frame, lines, first_frame, n_lines))
+				return 1;
+			else if (late && !late_check(frame, lines, first_frame, n_lines, cvbs->dropped_lines - dropped))
+				return 1;
+		}
+#if CVBS_GRAPHICS_128X96_SPRITES
+		if (sprites && !sprites_check(frame, lines, n_lines))
+			return 1;
+#endif
+#if CVBS_TEXT_32X24_RENDER_AHEAD
+		if (ring)
+			fprintf(stderr, "%s: %lu render-ahead underruns.\n", path, (unsigned long)(cvbs_text.ring_underruns - underruns));
+		underruns = cvbs_text.ring_underruns;
+#endif
+	}
+#if CVBS_PROFILE
+	if (profile) {
+		cvbs_profile_t p;
+		cvbs_profile_snapshot(&p);
+		cvbs_profile_print(&p, profile_write);
+	}
+#endif
+
+	cvbs_finish(cvbs);
+	return 0;
+}
@@ -0,0 +1,134 @@
+/*
+ * Host check of the generated pulse tables.
+ *
+ * Walks every standard's pulse sequence with cvbs_step(), as the ISR does,
+ * and checks it against counts taken from the standards themselves, not from
+ * the generator: whole and half lines add up to the frame, each field is
+ * exactly half of it, so interlaced fields are offset by half a line, and
+ * every field has one block of active lines, numbered from 0 without a gap. Runs
+ * must fit a cvbs_pulse_t, and runs of the same pulse must have been merged,
+ * unless split at 255. Normal syncs must start on the grid of whole lines,
+ * only equalizing and vsync pulses fall on the half lines between.
+ *
+ * Usage: host_timing
+ */
+#include <stdio.h>
+#include "ch32v003_cvbs.h"
+
+typedef struct standard_s {
+	const char *name;
+	cvbs_standard_t standard;
+	unsigned lines;     // Per frame
+	unsigned fields;
+	unsigned active;    // Per field
+} standard_t;
+
+static const standard_t standards[] = {
+	{ "PAL",       CVBS_STD_PAL,       625, 2, 240 },
+	{ "ZX81_PAL",  CVBS_STD_ZX81_PAL,  312, 1, 192 },
+	{ "ZX81_NTSC", CVBS_STD_ZX81_NTSC, 262, 1, 192 },
+	{ "NTSC",      CVBS_STD_NTSC,      525, 2, 240 },
+	{ "PAL_288P",  CVBS_STD_PAL_288P,  312, 1, 288 },
+};
+
+static bool same_pulse(const cvbs_pulse_t *a, const cvbs_pulse_t *b) {
+	return a->half_period == b->half_period && a->short_sync == b->short_sync &&
+		a->long_sync == b->long_sync && a->active == b->active;
+}
+
+static bool check(const standard_t *s) {
+	static cvbs_context_t ctx;
+	cvbs_context_init(&ctx, s->standard);
+	const cvbs_pulse_properties_t *pp = ctx.pulse_properties;
+	const cvbs_pulse_t *seq = pp->pulse_sequence;
+
+	unsigned runs = 0, halfs = 0;
+	for (const cvbs_pulse_t *p = seq; p->duration; p++, runs++) {
+		if (runs && same_pulse(p, p-1) && p[-1].duration != 255) {
+			printf("%s: run %u not merged with the one before.\n", s->name, runs);
+			return false;
+		}
+		halfs += p->duration * (p->half_period ? 1 : 2);
+	}
+	if (halfs != 2*s->lines) {
+		printf("%s: %u half lines, expected %u.\n", s->name, halfs, 2*s->lines);
+		return false;
+	}
+
+	// One frame of update events, from the start of the sequence.
+	ctx.pulse_index = 0;
+	ctx.current_pulse = seq[0];
+	ctx.pulse_counter = ctx.current_pulse.duration;
+	ctx.line = 0;
+
+	unsigned fields = 0, field_halfs = 0, active_blocks = 0, active = 0;
+	bool was_long = false, was_active = false;
+	for (unsigned t=0; t<halfs; ) {
+		cvbs_pulse_t p = ctx.current_pulse;
+		uint16_t period = cvbs_horizontal_period(&ctx);
+		if (cvbs_sync(&ctx) + pp->sync_short > period) {
+			printf("%s: sync of %u cycles in a %u cycle line.\n", s->name, cvbs_sync(&ctx), period);
+			return false;
+		}
+
+		// Half lines are counted from the first vsync, on the grid when even.
+		if (!p.short_sync && !p.long_sync && t%2) {
+			printf("%s: normal sync at half line %u.\n", s->name, t);
+			return false;
+		}
+
+		// A field starts with its vertical sync.
+		if (p.long_sync && !was_long) {
+			if (fields && field_halfs != 2*s->lines/s->fields) {
+				printf("%s: field %u is %u half lines.\n", s->name, fields-1, field_halfs);
+				return false;
+			}
+			if (active_blocks != fields) {
+				printf("%s: %u active blocks in %u fields.\n", s->name, active_blocks, fields);
+				return false;
+			}
+			fields++;
+			field_halfs = 0;
+		}
+
+		if (p.active) {
+			if (!was_active) {
+				active_blocks++;
+				active = 0;
+			}
+			if (ctx.line != active) {
+				printf("%s: active line %u numbered %d.\n", s->name, active, ctx.line);
+				return false;
+			}
+			active++;
+		} else if (was_active && active != s->active) {
+			printf("%s: %u active lines, expected %u.\n", s->name, active, s->active);
+			return false;
+		}
+
+		was_long = p.long_sync;
+		was_active = p.active;
+		field_halfs += p.half_period ? 1 : 2;
+		t += p.half_period ? 1 : 2;
+		cvbs_step(&ctx);
+	}
+	if (fields != s->fields || active_blocks != fields || field_halfs != 2*s->lines/s->fields) {
+		printf("%s: %u fields, %u active blocks, last field %u half lines.\n", s->name, fields, active_blocks, field_halfs);
+		return false;
+	}
+	if (ctx.pulse_index || ctx.pulse_counter != seq[0].duration) {
+		printf("%s: sequence does not wrap after %u lines.\n", s->name, s->lines);
+		return false;
+	}
+
+	printf("%-9s %3u lines, %u field%s of %3u active lines, %2u runs\n",
+		s->name, s->lines, fields, fields > 1 ? "s" : "", s->active, runs);
+	return true;
+}
+
+int main() {
+	bool ok = true;
+	for (unsigned i=0; i<sizeof(standards)/sizeof(*standards); i++)
+		ok &= check(&standards[i]);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+#include "host_tv.h"
+#include "ch32v003fun.h"
+#include <stdio.h>
+#include <string.h>
+
+void TIM1_UP_IRQHandler(void);
+
+// Active copies of preloaded TIM1 registers, updated on each update event.
+static uint32_t active_ATRLR, active_CH1CVR, active_CH3CVR;
+
+unsigned host_tv_latency;
+unsigned long host_tv_events;
+host_line_t host_tv_wfi_line;
+
+void host_tv_update_event(host_line_t *line) {
+	cvbs_context_t *cvbs = cvbs_get_active_context();
+	memset(line, 0, sizeof(*line));
+	host_tv_events++;
+
+	// Preload registers take effect on the update event.
+	active_ATRLR  = TIM1->ATRLR;
+	active_CH1CVR = TIM1->CH1CVR;
+	active_CH3CVR = TIM1->CH3CVR;
+	TIM1->CNT = host_tv_latency;
+
+	if (cvbs) {
+		line->pulse = cvbs->current_pulse;
+		line->pulse_index = cvbs->pulse_index;
+	}
+
+	TIM1->INTFR |= TIM_UIF;
+	if (host_NVIC_enabled[TIM1_UP_IRQn] && (TIM1->DMAINTENR & TIM_UIE))
+		TIM1_UP_IRQHandler();
+
+	line->period = active_ATRLR;
+	line->sync = active_CH1CVR;
+	line->dma_start = active_CH3CVR;
+	line->spi_prescaler = 2 << ((SPI1->CTLR1 & SPI_CTLR1_BR) / SPI_BaudRatePrescaler_4);
+	line->dma_armed =
+		(TIM1->DMAINTENR & TIM_CC3DE) &&
+		(DMA1_Channel6->CFGR & DMA_CFGR1_EN) &&
+		(DMA1_Channel3->CFGR & DMA_CFGR1_EN) &&
+		active_CH3CVR < active_ATRLR;
+
+	if (line->dma_armed) {
+		// DMA6 copies the byte count into DMA3, which then feeds SPI.
+		const uint32_t *count = (const uint32_t *)(uintptr_t)DMA1_Channel6->MADDR;
+		const uint8_t *src = (const uint8_t *)(uintptr_t)DMA1_Channel3->MADDR;
+		line->data_length = *count;
+		unsigned n = line->data_length < HOST_LINE_MAX_DATA ? line->data_length : HOST_LINE_MAX_DATA;
+		memcpy(line->data, src, n);
+	}
+
+	TIM1->CNT = active_ATRLR;
+	SysTick->CNT += active_ATRLR;
+}
+
+void host_wfi(void) {
+	host_tv_update_event(&host_tv_wfi_line);
+}
+
+unsigned host_tv_frame_lines(const cvbs_context_t *ctx) {
+	unsigned n = 0;
+	for (const cvbs_pulse_t *p = ctx->pulse_properties->pulse_sequence; p->duration; p++)
+		n += p->duration;
+	return n;
+}
+
+bool host_tv_is_frame_start(const cvbs_context_t *ctx) {
+	const cvbs_pulse_t *seq = ctx->pulse_properties->pulse_sequence;
+	return ctx->pulse_index == 0 && ctx->pulse_counter == seq[0].duration && ctx->current_pulse.duration;
+}
+
+bool host_tv_sync_to_frame(void) {
+	cvbs_context_t *cvbs = cvbs_get_active_context();
+	if (!cvbs)
+		return false;
+
+	// Worst case: uninitialized counter wraps (256), plus one full sequence.
+	unsigned limit = 256 + 2*host_tv_frame_lines(cvbs);
+	host_line_t line;
+	while (limit--) {
+		if (host_tv_is_frame_start(cvbs))
+			return true;
+		host_tv_update_event(&line);
+	}
+	return false;
+}
+
+int host_tv_write_pgm(const char *path, const host_line_t *lines, unsigned n) {
+	enum { SYNC = 0, BLANK = 77, WHITE = 255, CYCLES_PER_COLUMN = 4 };
+
+	unsigned period = 0;
+	for (unsigned i=0; i<n; i++)
+		if (lines[i].period > period) period = lines[i].period;
+	unsigned width = (period + CYCLES_PER_COLUMN-1) / CYCLES_PER_COLUMN;
+
+	FILE *f = fopen(path, "wb");
+	if (!f)
+		return -1;
+
+	fprintf(f, "P5\n%u %u\n255\n", width, n);
+	uint8_t row[width];
+	for (unsigned i=0; i<n; i++) {
+		const host_line_t *l = &lines[i];
+		for (unsigned x=0; x<width; x++) {
+			unsigned t = x * CYCLES_PER_COLUMN;
+			uint8_t v = t < l->sync ? SYNC : BLANK;
+
+			if (l->dma_armed && t >= l->dma_start) {
+				unsigned bit = (t - l->dma_start) / l->spi_prescaler;
+				unsigned byte = bit / 8;
+				if (byte < l->data_length && byte < HOST_LINE_MAX_DATA && (l->data[byte] & (0x80 >> bit%8)))
+					v = WHITE;
+			}
+			row[x] = t < l->period ? v : BLANK;
+		}
+		fwrite(row, 1, width, f);
+	}
+
+	return fclose(f);
+}
@@ -0,0 +1,48 @@
+// Host model of the TV side of the CVBS output.
+//
+// Emulates what TIM1, SPI1 and the DMA1 channel 3/6 chain do around
+// TIM1_UP_IRQHandler: shadow registers are latched on every update event, the
+// ISR is called, and the pixel bytes the DMA would shift out are captured.
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "ch32v003_cvbs.h"
+
+#define HOST_LINE_MAX_DATA 64
+
+typedef struct host_line_s {
+    cvbs_pulse_t pulse;     // Pulse state describing this line
+    uint8_t pulse_index;
+
+    uint16_t period;        // SYSCLK cycles, ATRLR as latched on update
+    uint16_t sync;          // SYSCLK cycles, CH1 compare as latched
+    uint16_t dma_start;     // SYSCLK cycles, CH3 compare as latched
+    bool dma_armed;         // CC3DE was set when CH3 matched
+    uint8_t spi_prescaler;  // SYSCLK cycles per pixel
+    uint16_t data_length;   // Bytes the DMA was asked to send
+    uint8_t data[HOST_LINE_MAX_DATA];
+} host_line_t;
+
+// TIM1 cycles counted by the time the ISR starts, interrupt latency. Set it
+// per update event to model a late ISR.
+extern unsigned host_tv_latency;
+
+// Runs one update event: latch shadows, call the ISR, emulate DMA.
+void host_tv_update_event(host_line_t *line);
+
+// Update events run so far, and the line the last one run by __WFI() captured.
+extern unsigned long host_tv_events;
+extern host_line_t host_tv_wfi_line;
+
+// Number of update events in a full pulse sequence.
+unsigned host_tv_frame_lines(const cvbs_context_t *ctx);
+
+// True if the next update event starts the pulse sequence over.
+bool host_tv_is_frame_start(const cvbs_context_t *ctx);
+
+// Runs update events until the next one starts a frame. Returns false if the
+// sequence never wraps (ISR disabled or broken pulse table).
+bool host_tv_sync_to_frame(void);
+
+// Renders captured lines to a binary PGM, 4 SYSCLK cycles per column.
+int host_tv_write_pgm(const char *path, const host_line_t *lines, unsigned n);
@@ -15,10 +15,20 @@
 #include "uart_dma.h"
 #include "gfx_demo_noise.h"
 #include "gfx_demo_mandelbrot.h"
+#include "ch32v003_cvbs_format.h"
+
+// Times the text kernels after the demos. Stops video meanwhile, so the TV
+// loses sync, and holds the results on screen for 5s.
+#ifndef CVBS_KERNEL_BENCH
+#define CVBS_KERNEL_BENCH 0
+#endif
+#if CVBS_KERNEL_BENCH
+#include "cvbs_bench.h"
+#endif
 
 static void graphics_demos() {
 	cvbs_graphics_128x96_context_t cvbs_gfx;
-	cvbs_graphics_128x96_context_init(&cvbs_gfx);
+	cvbs_graphics_128x96_context_init(&cvbs_gfx, CVBS_STD_ZX81_NTSC);
 	cvbs_init(&cvbs_gfx.cvbs);
 
 	v81_mandelbrot_128x96(&cvbs_gfx);
@@ -27,10 +37,29 @@ static void graphics_demos() {
 	cvbs_finish(&cvbs_gfx.cvbs);
 }
 
+#if CVBS_KERNEL_BENCH
+static cvbs_text_32x24_context_t *bench_text;
+
+static int bench_write(const char *buf, int size) {
+	return cvbs_text_32x24_write(bench_text, buf, size);
+}
+
+// Times every linked text kernel over the current VRAM contents.
+static void kernel_bench(cvbs_text_32x24_context_t *cvbs_text) {
+	cvbs_bench_result_t res[8];
+	int n = cvbs_bench_kernels(&cvbs_text->cvbs, cvbs_text_32x24_kernels, res, sizeof(res)/sizeof(*res));
+
+	bench_text = cvbs_text;
+	bench_write("\f", 1);
+	cvbs_bench_print(res, n, cvbs_horizontal_period(&cvbs_text->cvbs), bench_write);
+	Delay_Ms(5000);
+}
+#endif
+
 static void text_demos() {
 	cvbs_text_32x24_context_t cvbs_text;
 
-	cvbs_text_32x24_context_init(&cvbs_text);
+	cvbs_text_32x24_context_init(&cvbs_text, CVBS_STD_ZX81_NTSC);
 	cvbs_text.active_font = zx81_ascii_font;
 	cvbs_init(&cvbs_text.cvbs);
 
@@ -38,10 +67,13 @@ static void text_demos() {
 	hanoi_main(&cvbs_text);
 
 	v81_mandelbrot(&cvbs_text);
+#if CVBS_KERNEL_BENCH
+	kernel_bench(&cvbs_text);
+#endif
 
 	for (int i=0; i<30; i++) {
 		Delay_Ms( 1000 );
-		printf("%d, AD=%ld, BD=%ld, T=%d.\n",
+		cvbs_text_32x24_printf(&cvbs_text, "%d, AD=%ld, BD=%ld, T=%d.\n",
 			i,
 			TIM1_UP_IRQHandler_active_duration,
 			TIM1_UP_IRQHandler_blank_duration,
@@ -1,18 +1,28 @@
+#include <string.h>
+#include "ch32v003fun.h"
 #include "ch32v003_cvbs_text_32x24.h"
 
+// Fixed point format of the kernel, Q24 in 32 bits: 7 integer bits hold the
+// largest |k| before escape is detected, 24 fraction bits keep the demo views
+// within a few pixels of the double reference.
+#define MANDELBROT_Q 24
+#define MANDELBROT_FIXED(v) ((int32_t)((v) * (1L << MANDELBROT_Q)))
+
 typedef struct mandelbrot_context_s {
 	// Where on screen is (0,0).
 	// Counted in low-res pixels from top left.
 	// Each VRAM character symbol is 2x2.
 	int x0, y0;
 
-	// Zoom control, distance between pixels
-	double dx, dy;
+	// Zoom control, distance between pixels, MANDELBROT_FIXED(...)
+	int32_t dx, dy;
 
 	cvbs_text_32x24_context_t *cvbs_text;
 } mandelbrot_context_t;
 
-int is_mandlebrot(double re, double im) {
+// Reference version in double. Every operation is a soft-float call on the
+// CH32V003, so only the host uses it, to check is_mandlebrot().
+int is_mandlebrot_double(double re, double im) {
 	double tr = 0;
 	double ti = 0;
 	double kr,ki;
@@ -32,34 +42,368 @@ int is_mandlebrot(double re, double im) {
 	return tr*tr + ti*ti < 1;
 }
 
+// Rounded (a*b) >> shift, for shifts of 17 to 31, from four 16x16 bit
+// products. RV32EC has no multiplier, and a 64 bit product is a __muldi3
+// call doing the same partial products plus 64 bit carries. Exact while
+// |a| and |b| are below 2^27, 8 in Q24, and the result fits 32 bits.
+static inline int32_t mandelbrot_mul(int32_t a, int32_t b, int shift) {
+	int32_t ah = a >> 16, bh = b >> 16;
+	uint32_t al = a & 0xFFFF, bl = b & 0xFFFF;
+	int32_t mid = ah*(int32_t)bl + (int32_t)al*bh + (int32_t)(al*bl >> 16) + (1 << (shift-17));
+	return (int32_t)((uint32_t)(ah*bh) << (32-shift)) + (mid >> (shift-16));
+}
+
+// Same iteration as is_mandlebrot_double(), re and im in MANDELBROT_Q, with
+// 32 bit products only. A component of k beyond 2 escapes before squaring,
+// which keeps the squares, and the next t, in range of mandelbrot_mul() for
+// |c| < 4.
+//
+// Interior orbits settle into a cycle, and in fixed point the cycle repeats
+// exactly. Brent's method spots it, then the remaining iterations are cut to
+// the position within the cycle, so the final |t| test sees the same t.
+int is_mandlebrot(int32_t re, int32_t im) {
+	const int Q = MANDELBROT_Q;
+	const int32_t two = 2 << Q;
+	int32_t tr = 0;
+	int32_t ti = 0;
+	int32_t saved_r = 0;
+	int32_t saved_i = 0;
+	int steps = 0;
+	int limit = 1;
+
+	for (int i=0; i<100; i++) {
+		// k = t*t+c;
+		int32_t kr = mandelbrot_mul(tr, tr, Q) - mandelbrot_mul(ti, ti, Q) + re;
+		int32_t ki = mandelbrot_mul(tr, ti, Q-1) + im;
+		// t = k*k+c;
+		if (kr > two || kr < -two || ki > two || ki < -two)
+			return 0;
+		int32_t krkr = mandelbrot_mul(kr, kr, Q);
+		int32_t kiki = mandelbrot_mul(ki, ki, Q);
+		if (krkr+kiki > 2*two) return 0;
+
+		tr = krkr - kiki + re;
+		ti = mandelbrot_mul(kr, ki, Q-1) + im;
+
+		steps++;
+		if (tr == saved_r && ti == saved_i) {
+			// Period is `steps`, skip whole periods.
+			int left = 99 - i;
+			while (left >= steps)
+				left -= steps;
+			i = 99 - left;
+			limit = 0;
+		} else if (steps == limit) {
+			saved_r = tr;
+			saved_i = ti;
+			steps = 0;
+			limit <<= 1;
+		}
+	}
+	return mandelbrot_mul(tr, tr, Q) + mandelbrot_mul(ti, ti, Q) < 1 << Q;
+}
+
 int mandlebrot_pixel(int x, int y, const mandelbrot_context_t *ctx) {
-	double cr = (x - ctx->x0) * ctx->dx;
-	double ci = (y - ctx->y0) * ctx->dy;
+	int32_t cr = (x - ctx->x0) * ctx->dx;
+	int32_t ci = (y - ctx->y0) * ctx->dy;
 	return is_mandlebrot(cr,ci);
 }
 
-void v81_mandelbrot_screen(const mandelbrot_context_t *ctx) {
-	const unsigned HEIGHT = 48;
-	const unsigned WIDTH = 64;
-	for (int y=0; y<HEIGHT; y+=2) {
-		for (int x=0; x<WIDTH; x+=2) {
-			volatile uint8_t *vram = &ctx->cvbs_text->VRAM[y/2*32 + x/2];
-			*vram = 0x1f;
-
-			int tl = mandlebrot_pixel(x+0, y+0, ctx);
-			int tr = mandlebrot_pixel(x+1, y+0, ctx);
-			int bl = mandlebrot_pixel(x+0, y+1, ctx);
-			int br = mandlebrot_pixel(x+1, y+1, ctx);
-
-			*vram = (tl + tr*2 + bl*4) ^ (br ? 128^7 : 0);
-		}
+// Progressive Mariani-Silver renderer.
+//
+// Rectangles whose border is all inside or all outside are filled without
+// evaluating their interior, others are split in 4 by a cross of evaluated
+// pixels. Tiles are processed level by level, each level halving them, so the
+// image is refined coarse to fine. Split quadrants are previewed with the
+// colour of their top-left corner until their own level comes.
+//
+// Rows above the real axis are mirrored below it. All state is kept in
+// mandelbrot_render_t, so work can be spread over many calls.
+
+#ifndef mandelbrot_render_clock
+#define mandelbrot_render_clock() ((uint32_t)SysTick->CNT)
+#endif
+
+enum {
+	MANDELBROT_REGION,      // Set up rows, evaluate top row
+	MANDELBROT_BOTTOM,      // Evaluate bottom row
+	MANDELBROT_LEFT,        // Evaluate left column
+	MANDELBROT_RIGHT,       // Evaluate right column
+	MANDELBROT_TILE,        // Check border of a tile, fill it or split it
+	MANDELBROT_CROSS_LEFT,  // Evaluate left half of the horizontal split
+	MANDELBROT_CROSS_RIGHT, // Evaluate right half of the horizontal split
+	MANDELBROT_PREVIEW,     // Fill split quadrants with a guess
+	MANDELBROT_DONE,
+};
+
+typedef struct mandelbrot_render_s {
+	const mandelbrot_context_t *ctx;
+	int width, height;
+
+	// Pixel access to the target VRAM.
+	void *target;
+	bool (*get)(void *target, int x, int y);
+	void (*set)(void *target, int x, int y, bool on);
+
+	uint8_t state;
+	uint8_t region;         // 0 is the real axis and above, 1 rows with no mirror
+	uint8_t level;          // Tiles are split once per level
+	uint8_t skip_x, skip_y; // First levels split along one axis only, for square tiles
+	uint8_t tx, ty;         // Current tile
+	int16_t ya, yb;         // Rows of the region, inclusive
+
+	// Line of pixels being evaluated.
+	int16_t x, y;
+	int16_t remaining;
+	bool vertical;
+
+	uint32_t evaluations;
+} mandelbrot_render_t;
+
+// Edges and split lines of a tile. Unsplit axes have x[1] == x[2].
+typedef struct mandelbrot_tile_s {
+	int x[3], y[3];
+	bool split_x, split_y;
+} mandelbrot_tile_t;
+
+static void mandelbrot_render_init(mandelbrot_render_t *r, const mandelbrot_context_t *ctx, int width, int height,
+	void *target, bool (*get)(void *, int, int), void (*set)(void *, int, int, bool))
+{
+	memset(r, 0, sizeof(*r));
+	r->ctx = ctx;
+	r->width = width;
+	r->height = height;
+	r->target = target;
+	r->get = get;
+	r->set = set;
+}
+
+static void mandelbrot_render_put(mandelbrot_render_t *r, int x, int y, bool on) {
+	r->set(r->target, x, y, on);
+	int mirror = 2*r->ctx->y0 - y;
+	if (mirror != y && mirror >= 0 && mirror < r->height)
+		r->set(r->target, x, mirror, on);
+}
+
+static void mandelbrot_render_fill(mandelbrot_render_t *r, int xa, int ya, int xb, int yb, bool on) {
+	for (int y=ya; y<=yb; y++)
+		for (int x=xa; x<=xb; x++)
+			mandelbrot_render_put(r, x, y, on);
+}
+
+static void mandelbrot_render_line(mandelbrot_render_t *r, int x, int y, int n, bool vertical) {
+	r->x = x;
+	r->y = y;
+	r->remaining = n > 0 ? n : 0;
+	r->vertical = vertical;
+}
+
+// Splits along an axis so far, at a given level.
+static inline int mandelbrot_render_splits(int level, int skip) {
+	return level > skip ? level - skip : 0;
+}
+
+// Tile edge i of 2^splits, along a span of n pixels starting at o.
+static inline int mandelbrot_render_edge(int o, int n, int splits, int i) {
+	return o + ((n*i) >> splits);
+}
+
+static void mandelbrot_render_tile(mandelbrot_render_t *r, mandelbrot_tile_t *t) {
+	int nx = r->width - 1;
+	int ny = r->yb - r->ya;
+	int sx = mandelbrot_render_splits(r->level, r->skip_x);
+	int sy = mandelbrot_render_splits(r->level, r->skip_y);
+
+	t->split_x = r->level >= r->skip_x;
+	t->x[0] = mandelbrot_render_edge(0, nx, sx, r->tx);
+	t->x[2] = mandelbrot_render_edge(0, nx, sx, r->tx+1);
+	t->x[1] = t->split_x ? mandelbrot_render_edge(0, nx, sx+1, 2*r->tx+1) : t->x[2];
+
+	t->split_y = r->level >= r->skip_y;
+	t->y[0] = mandelbrot_render_edge(r->ya, ny, sy, r->ty);
+	t->y[2] = mandelbrot_render_edge(r->ya, ny, sy, r->ty+1);
+	t->y[1] = t->split_y ? mandelbrot_render_edge(r->ya, ny, sy+1, 2*r->ty+1) : t->y[2];
+}
+
+// Colour of a rectangle border, or -1 if mixed.
+static int mandelbrot_render_border(mandelbrot_render_t *r, int xa, int ya, int xb, int yb) {
+	bool on = r->get(r->target, xa, ya);
+	for (int x=xa; x<=xb; x++)
+		if (r->get(r->target, x, ya) != on || r->get(r->target, x, yb) != on)
+			return -1;
+	for (int y=ya+1; y<yb; y++)
+		if (r->get(r->target, xa, y) != on || r->get(r->target, xb, y) != on)
+			return -1;
+	return on;
+}
+
+static void mandelbrot_render_next_tile(mandelbrot_render_t *r) {
+	r->state = MANDELBROT_TILE;
+	if (++r->tx < 1 << mandelbrot_render_splits(r->level, r->skip_x))
+		return;
+	r->tx = 0;
+	if (++r->ty < 1 << mandelbrot_render_splits(r->level, r->skip_y))
+		return;
+	r->ty = 0;
+
+	// Go on while tiles of the next level have an interior.
+	int sx = mandelbrot_render_splits(r->level+1, r->skip_x);
+	int sy = mandelbrot_render_splits(r->level+1, r->skip_y);
+	if (r->width - 1 > 1 << sx && r->yb - r->ya > 1 << sy) {
+		r->level++;
+	} else {
+		r->region++;
+		r->state = MANDELBROT_REGION;
+	}
+}
+
+// Queues the next line of evaluations, or does the cheap work in between.
+static void mandelbrot_render_next(mandelbrot_render_t *r) {
+	mandelbrot_tile_t t;
+	const int y0 = r->ctx->y0;
+
+	switch (r->state) {
+		case MANDELBROT_REGION:
+			if (r->region == 0) {
+				r->ya = 0;
+				r->yb = y0 < r->height ? y0 : r->height-1;
+			} else if (r->region == 1) {
+				r->ya = y0 >= 0 ? 2*y0 + 1 : 0;
+				r->yb = r->height-1;
+			} else {
+				r->state = MANDELBROT_DONE;
+				return;
+			}
+			if (r->ya > r->yb) {
+				r->region++;
+				return;
+			}
+
+			r->level = 0;
+			r->skip_x = 0;
+			r->skip_y = 0;
+			while ((r->width - 1) >> (r->skip_y + 1) >= r->yb - r->ya)
+				r->skip_y++;
+			while ((r->yb - r->ya) >> (r->skip_x + 1) >= r->width - 1)
+				r->skip_x++;
+
+			mandelbrot_render_line(r, 0, r->ya, r->width, false);
+			r->state = MANDELBROT_BOTTOM;
+			return;
+
+		case MANDELBROT_BOTTOM:
+			if (r->yb > r->ya)
+				mandelbrot_render_line(r, 0, r->yb, r->width, false);
+			r->state = MANDELBROT_LEFT;
+			return;
+
+		case MANDELBROT_LEFT:
+			mandelbrot_render_line(r, 0, r->ya+1, r->yb - r->ya - 1, true);
+			r->state = MANDELBROT_RIGHT;
+			return;
+
+		case MANDELBROT_RIGHT:
+			mandelbrot_render_line(r, r->width-1, r->ya+1, r->yb - r->ya - 1, true);
+			r->state = MANDELBROT_TILE;
+			return;
+
+		case MANDELBROT_TILE:
+			mandelbrot_render_tile(r, &t);
+			if (t.x[2] - t.x[0] < 2 || t.y[2] - t.y[0] < 2) {
+				mandelbrot_render_next_tile(r);
+				return;
+			}
+
+			int on = mandelbrot_render_border(r, t.x[0], t.y[0], t.x[2], t.y[2]);
+			if (on >= 0) {
+				mandelbrot_render_fill(r, t.x[0]+1, t.y[0]+1, t.x[2]-1, t.y[2]-1, on);
+				mandelbrot_render_next_tile(r);
+				return;
+			}
+
+			if (t.split_x)
+				mandelbrot_render_line(r, t.x[1], t.y[0]+1, t.y[2] - t.y[0] - 1, true);
+			r->state = MANDELBROT_CROSS_LEFT;
+			return;
+
+		case MANDELBROT_CROSS_LEFT:
+			mandelbrot_render_tile(r, &t);
+			if (t.split_y)
+				mandelbrot_render_line(r, t.x[0]+1, t.y[1], t.x[1] - t.x[0] - 1, false);
+			r->state = MANDELBROT_CROSS_RIGHT;
+			return;
+
+		case MANDELBROT_CROSS_RIGHT:
+			mandelbrot_render_tile(r, &t);
+			if (t.split_y && t.split_x)
+				mandelbrot_render_line(r, t.x[1]+1, t.y[1], t.x[2] - t.x[1] - 1, false);
+			r->state = MANDELBROT_PREVIEW;
+			return;
+
+		case MANDELBROT_PREVIEW:
+			mandelbrot_render_tile(r, &t);
+			for (int j=0; j<=t.split_y; j++)
+				for (int i=0; i<=t.split_x; i++)
+					mandelbrot_render_fill(r, t.x[i]+1, t.y[j]+1, t.x[i+1]-1, t.y[j+1]-1,
+						r->get(r->target, t.x[i], t.y[j]));
+			mandelbrot_render_next_tile(r);
+			return;
 	}
 }
 
+// Renders for about `budget` mandelbrot_render_clock() ticks, SysTick cycles
+// on target, or to the end if budget is 0. One pixel evaluation is the unit of
+// work, so a step may run over by one. Returns true once the image is done.
+static bool mandelbrot_render_step(mandelbrot_render_t *r, uint32_t budget) {
+	uint32_t start = mandelbrot_render_clock();
+	do {
+		if (r->remaining) {
+			r->evaluations++;
+			mandelbrot_render_put(r, r->x, r->y, mandlebrot_pixel(r->x, r->y, r->ctx));
+			if (r->vertical) r->y++;
+			else r->x++;
+			r->remaining--;
+		} else if (r->state == MANDELBROT_DONE) {
+			return true;
+		} else {
+			mandelbrot_render_next(r);
+		}
+	} while (!budget || mandelbrot_render_clock() - start < budget);
+	return false;
+}
+
+// Semigraphics target, 2x2 pixels per character, see v81_mandelbrot_screen().
+static bool mandelbrot_text_get(void *target, int x, int y) {
+	uint8_t c = cvbs_text_32x24_row(target, y/2)[x/2];
+	unsigned bit = (y&1)*2 + (x&1);
+	if (bit == 3) return c & 0x80;
+	return ((c & 0x80 ? ~c : c) >> bit) & 1;
+}
+
+static void mandelbrot_text_set(void *target, int x, int y, bool on) {
+	uint8_t *vram = &cvbs_text_32x24_row(target, y/2)[x/2];
+	uint8_t c = *vram;
+	unsigned bits = (c & 0x80 ? ~c & 7 : c & 7) | (c & 0x80 ? 8 : 0);
+	unsigned bit = 1 << ((y&1)*2 + (x&1));
+	bits = on ? bits | bit : bits & ~bit;
+	*vram = (bits & 7) ^ (bits & 8 ? 128^7 : 0);
+}
+
+void v81_mandelbrot_screen(const mandelbrot_context_t *ctx) {
+	// Each character is 2x2 pixels: tl + tr*2 + bl*4, inverted if br.
+	for (int row=0; row<24; row++)
+		memset(cvbs_text_32x24_row(ctx->cvbs_text, row), 0, 32);
+
+	mandelbrot_render_t r;
+	mandelbrot_render_init(&r, ctx, 64, 48, ctx->cvbs_text, mandelbrot_text_get, mandelbrot_text_set);
+	while (!mandelbrot_render_step(&r, 48000*10))
+		cvbs_text_32x24_wait_for_vsync(ctx->cvbs_text);
+}
+
 void v81_mandelbrot(cvbs_text_32x24_context_t *cvbs_text) {
 	mandelbrot_context_t ctx = {
 		48, 24,
-		1./32, 1./32,
+		MANDELBROT_FIXED(1./32), MANDELBROT_FIXED(1./32),
 		cvbs_text
 	};
 
@@ -0,0 +1,126 @@
+#! /usr/bin/env python3
+# Generates pulses.h, the cvbs_pulse_properties_t of every standard, from a
+# few parameters each instead of hand counted tables.
+#
+# Times are in half lines from the start of the first vertical sync. Every
+# field is an equalizing/vsync block, then lines on the grid of whole lines
+# from that start. Where the block ends off the grid its last post-equalizing
+# pulse takes a whole line, and where the next one starts off it a blank half
+# line leads into it. Whole lines are blank, then active, then blank, the
+# active ones centered on the standard's visible area unless `top` is given.
+# Adjacent runs of the same pulse are merged and split at 255, the most a
+# cvbs_pulse_t counts.
+#
+# Sources:
+# https://www.batsocks.co.uk/readme/video_timing.htm
+# https://www.nesdev.org/wiki/NTSC_video
+
+HCLK = 48e6
+
+# name: (comment, line us, lines per frame, interlaced,
+#        block (pre-equalizing, vsync, post-equalizing, serrated),
+#        blank lines before the visible area, visible lines, active lines, top)
+# Serrated blocks count half lines, others whole lines.
+standards = {
+    "PAL": ("PAL 50Hz interlaced, 240 active lines per field",
+        64, 625, True, (5, 5, 5, True), 17, 288, 240, None),
+    "ZX81_PAL": ("PAL 50Hz progressive, 192 active lines",
+        64, 312, False, (6, 5, 5, True), 17, 288, 192, None),
+    "ZX81_NTSC": ("NTSC 60Hz progressive, 192 active lines as NES 240p, then centered",
+        63.55, 262, False, (0, 3, 0, False), 0, 259, 192, 48),
+    "NTSC": ("NTSC 60Hz interlaced, 480i",
+        63.55, 525, True, (6, 6, 6, True), 12, 240, 240, None),
+    "PAL_288P": ("PAL 50Hz progressive, 288 active lines",
+        64, 312, False, (6, 5, 5, True), 17, 288, 288, None),
+}
+
+def cycles(us):
+    return int(HCLK * us * 1e-6 + 0.5)
+
+# One run per pulse kind: (half, short, long, active, count, comment)
+def runs_of(lines, interlaced, block, first_visible, visible, active, top):
+    pre, vsync, post, serrated = block
+    unit = 1 if serrated else 2
+    fields = 2 if interlaced else 1
+    h = int(serrated)
+
+    runs = []
+    for f in range(fields):
+        start = f*lines if interlaced else 0
+        end = (f+1)*lines if interlaced else 2*lines
+        # Lines on the grid, between this block and the next one's equalizing.
+        t = start + (vsync + post)*unit
+        next_block = end - pre*unit
+        lead = t % 2
+        trail = next_block % 2
+
+        # Off the grid, the last post-equalizing pulse takes a whole line, so
+        # no sync starts on the half line after it.
+        runs.append((h, 0, 1, 0, vsync, "Vsync"))
+        assert post or not lead, "no post-equalizing to reach the grid"
+        if post:
+            runs.append((h, 1, 0, 0, post - lead, "Post-equalizing"))
+        if lead:
+            runs.append((0, 1, 0, 0, 1, "Post-equalizing"))
+
+        whole = (next_block - t - lead - trail) // 2
+        assert whole >= active, "active lines do not fit"
+
+        if top is None:
+            field_top = first_visible + (visible - active) // 2
+        else:
+            field_top = top
+        field_top = max(0, min(field_top, whole - active))
+
+        runs.append((0, 0, 0, 0, field_top, "Top blank"))
+        runs.append((0, 0, 0, 1, active, "Active"))
+        runs.append((0, 0, 0, 0, whole - field_top - active, "Bottom blank"))
+        if trail:
+            runs.append((1, 0, 0, 0, 1, "Blank"))
+        if pre:
+            runs.append((h, 1, 0, 0, pre, "Pre-equalizing"))
+    return runs
+
+# Adjacent runs of the same pulse become one, then are split at 255.
+def merge(runs):
+    out = []
+    for r in runs:
+        if not r[4]:
+            continue
+        if out and out[-1][:4] == r[:4]:
+            out[-1] = r[:4] + (out[-1][4] + r[4], out[-1][5])
+        else:
+            out.append(r)
+    split = []
+    for r in out:
+        n = r[4]
+        while n > 255:
+            split.append(r[:4] + (255, r[5]))
+            n -= 255
+        split.append(r[:4] + (n, r[5]))
+    return split
+
+out = "// Generated by make_pulses.py, do not edit.\n"
+for name, (comment, line_us, lines, interlaced, block, first_visible, visible, active, top) in standards.items():
+    serrated = block[3]
+    runs = merge(runs_of(lines, interlaced, block, first_visible, visible, active, top))
+    halfs = sum(r[4] * (1 if r[0] else 2) for r in runs)
+    assert halfs == 2*lines, f"{name}: {halfs} half lines"
+
+    long_us = (line_us/2 if serrated else line_us) - 4.7
+    out += f"\n// {comment}, {lines} lines\n"
+    out += f"static const cvbs_pulse_properties_t {name}_pulse_properties = {{\n"
+    out += f"    .horizontal_period = {cycles(line_us)}, // 48MHz * {line_us}us\n"
+    out += f"    .sync_short        = {cycles(2.35)}, // 48MHz * 2.35us\n"
+    out += f"    .sync_normal       = {cycles(4.7)}, // 48MHz * 4.7us\n"
+    out += f"    .sync_long         = {cycles(long_us)}, // 48MHz * {long_us:.3f}us\n"
+    out += "    .pulse_sequence = {\n"
+    out += "    //   H  S  L  A    N\n"
+    for h, s, l, a, n, what in runs:
+        out += f"        {{{h}, {s}, {l}, {a}, {n:3}}}, // {what}{'/2' if h else ''}\n"
+    out += "        {0, 0, 0, 0,   0}, // END\n"
+    out += "    }\n"
+    out += "};\n"
+
+with open("pulses.h", "w") as f:
+    f.write(out)
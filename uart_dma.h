@@ -19,6 +19,15 @@ void uart_init(
 	USART1->GPR = 0;
 }
 
+// Blocking transmit, for reports such as cvbs_profile_print().
+int uart_write(const char *buf, int size) {
+	for (int i=0; i<size; i++) {
+		while (!(USART1->STATR & USART_FLAG_TXE));
+		USART1->DATAR = buf[i];
+	}
+	return size;
+}
+
 void uart_dma_rx_start(
 	uint8_t *rxbuff,
 	size_t rxlen
@@ -48,6 +57,7 @@ void uart_dma_rx_wait() {
 
 void uart_vram_demo(cvbs_text_32x24_context_t *cvbs_text) {
 	uart_init(921600);
+	cvbs_text_32x24_write(cvbs_text, "\f", 1); // Raw VRAM layout, no scrolling offset
 	while(true) {
 		cvbs_text_32x24_wait_for_vsync(cvbs_text);
 		USART1->DATAR = '.';